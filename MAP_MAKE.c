@@ -2,6 +2,10 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <stdint.h>
+#include <limits.h>
+
+#define PACK_BLOCK_VERTICES 4096
 
 enum Direction {
     RIGHT,
@@ -19,10 +23,122 @@ struct Node
 };
 
 
+struct PointOfInterest
+{
+    int vertex;
+    char tag[32];
+};
+
+
+// Vertex IDs are arbitrary 64-bit values, interned in the order they are first
+// seen; the adjacency lists are indexed by the resulting dense IDs.
+struct IdTable
+{
+    int count;
+    int capacity;
+    long long *key;
+    int *slot;
+    size_t slotMask;
+};
+
+
+// largestId is kept as vertices are added, so the save format can be chosen
+// without scanning the IDs; it is LLONG_MAX once any ID is negative or does
+// not fit an int.
 struct Graph
 {
     int V;
+    int capacity;
+    long long largestId;
+    struct IdTable *ids;
     struct Node **adjList;
+    struct PointOfInterest *pois;
+    int poiCount;
+    int poiCapacity;
+};
+
+
+struct TileHeader
+{
+    char magic[8];
+    uint32_t V;
+    uint32_t tileVertices;
+    uint32_t tileCount;
+    uint32_t poiCount;
+    uint64_t E;
+    uint64_t externalPos;
+    uint64_t directoryPos;
+    uint64_t poiPos;
+};
+
+
+struct TileEntry
+{
+    uint64_t position;
+    uint32_t size;
+    uint32_t edges;
+};
+
+
+struct TilePoi
+{
+    int32_t vertex;
+    char tag[32];
+};
+
+
+struct PackHeader
+{
+    char magic[8];
+    uint32_t V;
+    uint32_t blockVertices;
+    uint32_t blockCount;
+    uint32_t poiCount;
+    uint64_t E;
+    uint64_t directoryPos;
+    uint64_t poiPos;
+};
+
+
+struct PackBlock
+{
+    uint64_t position;
+    uint32_t size;
+    uint32_t edges;
+    uint32_t checksum;
+    uint32_t reserved;
+};
+
+
+struct PackedEdge
+{
+    int dest;
+    unsigned int code;
+};
+
+
+struct MapEdge
+{
+    int src;
+    int dest;
+    int distance;
+    enum Direction direction;
+};
+
+
+struct EdgeSetEntry
+{
+    int src;
+    int dest;
+    struct Node *node;
+};
+
+
+struct EdgeSet
+{
+    size_t capacity;
+    size_t count;
+    struct EdgeSetEntry *entries;
 };
 
 
@@ -38,56 +154,243 @@ struct Node *createNode(int data, int distance, enum Direction direction)
 
 
 
+size_t hashId(long long id)
+{
+    unsigned long long key = (unsigned long long)id + 0x9e3779b97f4a7c15ULL;
+    key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    key = (key ^ (key >> 27)) * 0x94d049bb133111ebULL;
+    return (size_t)(key ^ (key >> 31));
+}
+
+
+// Open addressing with linear probing; a slot holds dense ID + 1, 0 if empty.
+int *findIdSlot(struct IdTable *ids, long long id)
+{
+    size_t slot = hashId(id) & ids->slotMask;
+    while (ids->slot[slot] && ids->key[ids->slot[slot] - 1] != id)
+    {
+        slot = (slot + 1) & ids->slotMask;
+    }
+    return &ids->slot[slot];
+}
+
+
+int findId(struct IdTable *ids, long long id)
+{
+    return *findIdSlot(ids, id) - 1;
+}
+
+
+int internId(struct IdTable *ids, long long id)
+{
+    int *slot = findIdSlot(ids, id);
+    if (*slot)
+    {
+        return *slot - 1;
+    }
+    if (ids->count == ids->capacity)
+    {
+        ids->capacity = ids->capacity ? ids->capacity * 2 : 1024;
+        ids->key = (long long *)realloc(ids->key, ids->capacity * sizeof(long long));
+        if (!ids->key)
+        {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    ids->key[ids->count] = id;
+    *slot = ++ids->count;
+
+    if ((size_t)ids->count * 2 > ids->slotMask + 1)
+    {
+        free(ids->slot);
+        ids->slotMask = ids->slotMask * 2 + 1;
+        ids->slot = (int *)calloc(ids->slotMask + 1, sizeof(int));
+        if (!ids->slot)
+        {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+        for (int v = 0; v < ids->count; v++)
+        {
+            *findIdSlot(ids, ids->key[v]) = v + 1;
+        }
+    }
+    return ids->count - 1;
+}
+
+
+// Interns a vertex ID, giving it an empty adjacency list if it is new.
+int addVertex(struct Graph *graph, long long id)
+{
+    int v = internId(graph->ids, id);
+    if (v == graph->V)
+    {
+        if (graph->V == graph->capacity)
+        {
+            graph->capacity = graph->capacity ? graph->capacity * 2 : 16;
+            graph->adjList = (struct Node **)realloc(graph->adjList, graph->capacity * sizeof(struct Node *));
+            if (!graph->adjList)
+            {
+                perror("Memory allocation failed");
+                exit(EXIT_FAILURE);
+            }
+        }
+        graph->adjList[graph->V++] = NULL;
+        if (id < 0 || id >= INT_MAX)
+        {
+            graph->largestId = LLONG_MAX;
+        }
+        else if (id > graph->largestId)
+        {
+            graph->largestId = id;
+        }
+    }
+    return v;
+}
+
+
 struct Graph *createGraph(int V)
 {
     struct Graph *graph = (struct Graph *)malloc(sizeof(struct Graph));
-    
-    graph->V = V;
-    graph->adjList = (struct Node **)malloc(V * sizeof(struct Node *));
+    struct IdTable *ids = (struct IdTable *)calloc(1, sizeof(struct IdTable));
+    if (!graph || !ids)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    ids->slotMask = 1023;
+    ids->slot = (int *)calloc(ids->slotMask + 1, sizeof(int));
+    if (!ids->slot)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+
+    graph->V = 0;
+    graph->capacity = 0;
+    graph->largestId = -1;
+    graph->ids = ids;
+    graph->adjList = NULL;
+    graph->pois = NULL;
+    graph->poiCount = 0;
+    graph->poiCapacity = 0;
     
     for (int i = 0; i < V; i++)
     {
-        graph->adjList[i] = NULL;
+        addVertex(graph, i);
     }
     return graph;
 }
 
 
-void addEdge(struct Graph *graph, int src, int dest, int distance, enum Direction direction)
+void freeGraph(struct Graph *graph)
 {
-    if (src >= 0 && dest >= 0)
+    for (int i = 0; i < graph->V; i++)
     {
-        if (src >= graph->V || dest >= graph->V)
+        struct Node *temp = graph->adjList[i];
+        while (temp)
         {
-            
-            int newV = (src > dest ? src : dest) + 1;
-            graph->adjList = (struct Node **)realloc(graph->adjList, newV * sizeof(struct Node *));
-            
-            for (int i = graph->V; i < newV; i++)
-            {
-                graph->adjList[i] = NULL;
-            }
-            graph->V = newV;
+            struct Node *next = temp->next;
+            free(temp);
+            temp = next;
         }
+    }
+    free(graph->ids->key);
+    free(graph->ids->slot);
+    free(graph->ids);
+    free(graph->adjList);
+    free(graph->pois);
+    free(graph);
+}
+
 
-        struct Node *newNode = createNode(dest, distance, direction);
-        newNode->next = graph->adjList[src];
-        graph->adjList[src] = newNode;
+// Links u -> v between vertices that are already interned.
+void linkEdge(struct Graph *graph, int u, int v, int distance, enum Direction direction)
+{
+    struct Node *newNode = createNode(v, distance, direction);
+    newNode->next = graph->adjList[u];
+    graph->adjList[u] = newNode;
+}
+
+
+void addEdge(struct Graph *graph, long long src, long long dest, int distance, enum Direction direction)
+{
+    int u = addVertex(graph, src);
+    int v = addVertex(graph, dest);
+    linkEdge(graph, u, v, distance, direction);
+}
+
+
+// Maps whose IDs are small non-negative integers keep the classic format with
+// the vertex count on the first line; maps with negative or 64-bit IDs, or
+// with IDs so far apart that most of the count would be unused, are saved as
+// "sparse".
+bool classicIds(struct Graph *graph, int *V)
+{
+    if (graph->largestId >= 4LL * graph->V + 16)
+    {
+        *V = graph->V;
+        return false;
     }
-    else
+    *V = (int)(graph->largestId + 1);
+    return true;
+}
+
+
+
+// Tags a vertex as a point of interest; a vertex may carry several tags.
+// A dense map saved in the classic format has every ID below its vertex count,
+// so such an ID is interned even if no edge uses it yet. Returns false if the vertex is not in the map.
+bool addPointOfInterest(struct Graph *graph, long long id, const char *tag)
+{
+    int vertex = findId(graph->ids, id);
+    int V;
+    if (vertex == -1 && classicIds(graph, &V) && id >= 0 && id < V)
+    {
+        vertex = addVertex(graph, id);
+    }
+    if (vertex == -1)
     {
-        printf("Invalid input for nodes.\n");
+        return false;
+    }
+    for (int i = 0; i < graph->poiCount; i++)
+    {
+        if (graph->pois[i].vertex == vertex && strcmp(graph->pois[i].tag, tag) == 0)
+        {
+            printf("Vertex %lld is already tagged '%s'.\n", id, tag);
+            return true;
+        }
     }
+    if (graph->poiCount == graph->poiCapacity)
+    {
+        graph->poiCapacity = graph->poiCapacity ? graph->poiCapacity * 2 : 16;
+        graph->pois = (struct PointOfInterest *)realloc(graph->pois,
+                                                        graph->poiCapacity * sizeof(struct PointOfInterest));
+        if (!graph->pois)
+        {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    graph->pois[graph->poiCount].vertex = vertex;
+    strncpy(graph->pois[graph->poiCount].tag, tag, sizeof(graph->pois[graph->poiCount].tag) - 1);
+    graph->pois[graph->poiCount].tag[sizeof(graph->pois[graph->poiCount].tag) - 1] = '\0';
+    graph->poiCount++;
+    return true;
 }
 
 
 
 void printGraph(struct Graph *graph)
 {
-    for (int i = 0; i < graph->V; i++)
+    int V;
+    bool classic = classicIds(graph, &V);
+    for (int k = 0; k < V; k++)
     {
-        struct Node *temp = graph->adjList[i];
-        printf("Adjacency list of vertex %d: ", i);
+        int i = classic ? findId(graph->ids, k) : k;
+        struct Node *temp = i == -1 ? NULL : graph->adjList[i];
+        printf("Adjacency list of vertex %lld: ", i == -1 ? k : graph->ids->key[i]);
         while (temp)
         {
             char *directionStr;
@@ -105,30 +408,46 @@ void printGraph(struct Graph *graph)
                     directionStr = "back";
                     break;
             }
-            printf("%d (%d, %s) -> ", temp->data, temp->distance, directionStr);
+            printf("%lld (%d, %s) -> ", graph->ids->key[temp->data], temp->distance, directionStr);
             temp = temp->next;
         }
         printf("NULL\n");
     }
+    for (int i = 0; i < graph->poiCount; i++)
+    {
+        printf("Point of interest: %lld (%s)\n", graph->ids->key[graph->pois[i].vertex], graph->pois[i].tag);
+    }
 }
 
 
 
-void saveMapToFile(struct Graph *graph, const char *filename)
+// Returns false if the file could not be opened or fully written.
+bool saveMapToFile(struct Graph *graph, const char *filename)
 {
     
     FILE *file = fopen(filename, "w");
     if (!file)
     {
         perror("Failed to open the file for writing");
-        return;
+        return false;
     }
 
-    
-    fprintf(file, "%d\n", graph->V);
-    for (int i = 0; i < graph->V; i++)
+    // Classic maps list the vertices in ID order, sparse ones in the order
+    // their IDs were first seen.
+    int V;
+    bool classic = classicIds(graph, &V);
+    if (classic)
     {
-        struct Node *temp = graph->adjList[i];
+        fprintf(file, "%d\n", V);
+    }
+    else
+    {
+        fprintf(file, "sparse\n");
+    }
+    for (int k = 0; k < V; k++)
+    {
+        int i = classic ? findId(graph->ids, k) : k;
+        struct Node *temp = i == -1 ? NULL : graph->adjList[i];
         while (temp)
         {
             char *directionStr;
@@ -146,18 +465,883 @@ void saveMapToFile(struct Graph *graph, const char *filename)
                     directionStr = "back";
                     break;
             }
-            fprintf(file, "%d %d %d %s\n", i, temp->data, temp->distance, directionStr);
+            fprintf(file, "%lld %lld %d %s\n", graph->ids->key[i], graph->ids->key[temp->data], temp->distance,
+                    directionStr);
             temp = temp->next;
         }
     }
 
+    // Points of interest follow the edges so older readers stop before them.
+    for (int i = 0; i < graph->poiCount; i++)
+    {
+        fprintf(file, "poi %lld %s\n", graph->ids->key[graph->pois[i].vertex], graph->pois[i].tag);
+    }
+
    
+    bool failed = ferror(file) != 0;
+    if (fclose(file) != 0 || failed)
+    {
+        fprintf(stderr, "Failed to write %s\n", filename);
+        return false;
+    }
+    return true;
+}
+
+
+struct EdgeSet *createEdgeSet(void)
+{
+    struct EdgeSet *set = (struct EdgeSet *)malloc(sizeof(struct EdgeSet));
+    if (!set)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    set->capacity = 1024;
+    set->count = 0;
+    set->entries = (struct EdgeSetEntry *)calloc(set->capacity, sizeof(struct EdgeSetEntry));
+    if (!set->entries)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    return set;
+}
+
+
+size_t hashEdge(int src, int dest)
+{
+    unsigned long long key = ((unsigned long long)(unsigned int)src << 32) | (unsigned int)dest;
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return (size_t)key;
+}
+
+
+// Open addressing with linear probing; slots with a NULL node are empty.
+struct EdgeSetEntry *findEdgeSlot(struct EdgeSet *set, int src, int dest)
+{
+    size_t mask = set->capacity - 1;
+    size_t slot = hashEdge(src, dest) & mask;
+    while (set->entries[slot].node &&
+           (set->entries[slot].src != src || set->entries[slot].dest != dest))
+    {
+        slot = (slot + 1) & mask;
+    }
+    return &set->entries[slot];
+}
+
+
+void growEdgeSet(struct EdgeSet *set)
+{
+    struct EdgeSetEntry *old = set->entries;
+    size_t oldCapacity = set->capacity;
+    set->capacity *= 2;
+    set->entries = (struct EdgeSetEntry *)calloc(set->capacity, sizeof(struct EdgeSetEntry));
+    if (!set->entries)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < oldCapacity; i++)
+    {
+        if (old[i].node)
+        {
+            *findEdgeSlot(set, old[i].src, old[i].dest) = old[i];
+        }
+    }
+    free(old);
+}
+
+
+// Adds src -> dest unless that pair is already in the graph, in which case
+// the shorter of the two distances (and its direction) is kept.
+bool addUniqueEdge(struct Graph *graph, struct EdgeSet *set, long long srcId, long long destId, int distance,
+                   enum Direction direction)
+{
+    if ((set->count + 1) * 2 > set->capacity)
+    {
+        growEdgeSet(set);
+    }
+
+    int src = addVertex(graph, srcId);
+    int dest = addVertex(graph, destId);
+    struct EdgeSetEntry *entry = findEdgeSlot(set, src, dest);
+    if (entry->node)
+    {
+        if (distance < entry->node->distance)
+        {
+            entry->node->distance = distance;
+            entry->node->direction = direction;
+        }
+        return false;
+    }
+
+    linkEdge(graph, src, dest, distance, direction);
+    entry->src = src;
+    entry->dest = dest;
+    entry->node = graph->adjList[src];
+    set->count++;
+    return true;
+}
+
+
+// Reads "src dest distance direction" records separated by spaces or commas.
+// Blank lines, '#' comments, a CSV header and the vertex count line of an
+// existing map file are skipped, and "poi <id> <tag>" lines tag a vertex
+// already seen, so saved maps can be re-imported as well.
+void importEdges(struct Graph *graph, FILE *input)
+{
+    struct EdgeSet *set = createEdgeSet();
+    char line[512];
+    long lineNumber = 0, added = 0, collapsed = 0, invalid = 0;
+
+    while (fgets(line, sizeof(line), input))
+    {
+        lineNumber++;
+        for (char *c = line; *c; c++)
+        {
+            if (*c == ',' || *c == ';' || *c == '\t')
+            {
+                *c = ' ';
+            }
+        }
+
+        char *start = line + strspn(line, " \r\n");
+        if (*start == '\0' || *start == '#')
+        {
+            continue;
+        }
+
+        if (strncmp(start, "poi ", 4) == 0)
+        {
+            long long vertex;
+            char tag[32];
+            if (sscanf(start + 4, "%lld %31s", &vertex, tag) != 2 || !addPointOfInterest(graph, vertex, tag))
+            {
+                fprintf(stderr, "Line %ld: invalid point of interest, skipped.\n", lineNumber);
+                invalid++;
+                continue;
+            }
+            continue;
+        }
+
+        long long src, dest;
+        int distance;
+        char directionInput[16];
+        int fields = sscanf(start, "%lld %lld %d %15s", &src, &dest, &distance, directionInput);
+        if (lineNumber == 1 && (fields == 0 || fields == 1))
+        {
+            continue;
+        }
+
+        enum Direction direction;
+        if (fields != 4)
+        {
+            fprintf(stderr, "Line %ld: invalid edge, skipped.\n", lineNumber);
+            invalid++;
+            continue;
+        }
+        if (strcmp(directionInput, "right") == 0) {
+            direction = RIGHT;
+        } else if (strcmp(directionInput, "left") == 0) {
+            direction = LEFT;
+        } else if (strcmp(directionInput, "straight") == 0) {
+            direction = STRAIGHT;
+        } else if (strcmp(directionInput, "back") == 0) {
+            direction = BACK;
+        } else {
+            fprintf(stderr, "Line %ld: invalid direction '%s', skipped.\n", lineNumber, directionInput);
+            invalid++;
+            continue;
+        }
+
+        if (addUniqueEdge(graph, set, src, dest, distance, direction))
+        {
+            added++;
+        }
+        else
+        {
+            collapsed++;
+        }
+    }
+
+    printf("Imported %ld edges over %d vertices and %ld points of interest (%ld duplicates collapsed, %ld invalid "
+           "lines).\n", added, graph->V, (long)graph->poiCount, collapsed, invalid);
+    free(set->entries);
+    free(set);
+}
+
+
+int importMain(const char *edgeFile, const char *mapFile)
+{
+    FILE *input = strcmp(edgeFile, "-") == 0 ? stdin : fopen(edgeFile, "r");
+    if (!input)
+    {
+        perror("Failed to open the edge list");
+        return 1;
+    }
+
+    struct Graph *graph = createGraph(0);
+    importEdges(graph, input);
+    if (input != stdin)
+    {
+        fclose(input);
+    }
+    bool saved = saveMapToFile(graph, mapFile);
+    freeGraph(graph);
+    return saved ? 0 : 1;
+}
+
+// Writes the values of an array initialiser, twelve to a line.
+void writeEmbeddedInts(FILE *file, const char *declaration, const int *values, int count)
+{
+    fprintf(file, "%s = {", declaration);
+    for (int k = 0; k < count; k++)
+    {
+        fprintf(file, "%s%d%s", k % 12 == 0 ? "\n    " : " ", values[k], k < count - 1 ? "," : "");
+    }
+    fprintf(file, count ? "\n};\n\n" : "0};\n\n");
+}
+
+
+// Writes text as a C string literal. Quotes, backslashes and question marks
+// (which could start a trigraph) are escaped, and any other byte that is not
+// printable ASCII is written as a 3-digit octal escape, which cannot run into
+// the characters after it.
+void writeEmbeddedString(FILE *file, const char *text)
+{
+    fputc('"', file);
+    for (const unsigned char *c = (const unsigned char *)text; *c; c++)
+    {
+        if (*c == '"' || *c == '\\' || *c == '?')
+        {
+            fprintf(file, "\\%c", *c);
+        }
+        else if (*c < 32 || *c > 126)
+        {
+            fprintf(file, "\\%03o", *c);
+        }
+        else
+        {
+            fputc(*c, file);
+        }
+    }
+    fputc('"', file);
+}
+
+
+// A map file read into CSR arrays. Each vertex keeps its edges in the order
+// the navigator's loader would link them, newest first.
+struct MapArrays
+{
+    int V;
+    int E;
+    int *offsets;
+    int *targets;
+    int *weights;
+    int *directions;
+    struct PointOfInterest *pois;
+    int poiCount;
+};
+
+
+bool readMapArrays(const char *mapFile, struct MapArrays *map)
+{
+    FILE *input = fopen(mapFile, "r");
+    if (!input)
+    {
+        perror("Failed to open the file for reading");
+        return false;
+    }
+    int V;
+    if (fscanf(input, "%d", &V) != 1 || V < 0)
+    {
+        // A sparse map would first need its IDs renumbered.
+        fprintf(stderr, "Invalid file format (only maps with a vertex count can be converted)\n");
+        fclose(input);
+        return false;
+    }
+
+    int count = 0, capacity = 1024;
+    struct MapEdge *edges = (struct MapEdge *)malloc(capacity * sizeof(struct MapEdge));
+    int *offsets = (int *)calloc(V + 1, sizeof(int));
+    if (!edges || !offsets)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    int src, dest, distance;
+    char directionInput[10];
+    while (fscanf(input, "%d %d %d %9s", &src, &dest, &distance, directionInput) == 4)
+    {
+        enum Direction direction;
+        if (strcmp(directionInput, "right") == 0) {
+            direction = RIGHT;
+        } else if (strcmp(directionInput, "left") == 0) {
+            direction = LEFT;
+        } else if (strcmp(directionInput, "straight") == 0) {
+            direction = STRAIGHT;
+        } else if (strcmp(directionInput, "back") == 0) {
+            direction = BACK;
+        } else {
+            fprintf(stderr, "Edge %d -> %d: invalid direction '%s', skipped.\n", src, dest, directionInput);
+            continue;
+        }
+        if (src < 0 || src >= V || dest < 0 || dest >= V)
+        {
+            continue;
+        }
+        if (count == capacity)
+        {
+            capacity *= 2;
+            edges = (struct MapEdge *)realloc(edges, capacity * sizeof(struct MapEdge));
+            if (!edges)
+            {
+                perror("Memory allocation failed");
+                exit(EXIT_FAILURE);
+            }
+        }
+        edges[count].src = src;
+        edges[count].dest = dest;
+        edges[count].distance = distance;
+        edges[count].direction = direction;
+        offsets[src + 1]++;
+        count++;
+    }
+
+    int poiCount = 0, poiCapacity = 64;
+    struct PointOfInterest *pois = (struct PointOfInterest *)malloc(poiCapacity * sizeof(struct PointOfInterest));
+    if (!pois)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    int vertex;
+    char tag[32];
+    while (fscanf(input, " poi %d %31s", &vertex, tag) == 2)
+    {
+        if (vertex < 0 || vertex >= V)
+        {
+            continue;
+        }
+        if (poiCount == poiCapacity)
+        {
+            poiCapacity *= 2;
+            pois = (struct PointOfInterest *)realloc(pois, poiCapacity * sizeof(struct PointOfInterest));
+            if (!pois)
+            {
+                perror("Memory allocation failed");
+                exit(EXIT_FAILURE);
+            }
+        }
+        pois[poiCount].vertex = vertex;
+        strcpy(pois[poiCount].tag, tag);
+        poiCount++;
+    }
+    fclose(input);
+
+    for (int u = 0; u < V; u++)
+    {
+        offsets[u + 1] += offsets[u];
+    }
+    int *fill = (int *)malloc((V + 1) * sizeof(int));
+    map->targets = (int *)malloc((count + 1) * sizeof(int));
+    map->weights = (int *)malloc((count + 1) * sizeof(int));
+    map->directions = (int *)malloc((count + 1) * sizeof(int));
+    if (!fill || !map->targets || !map->weights || !map->directions)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    for (int u = 0; u < V; u++)
+    {
+        fill[u] = offsets[u + 1];
+    }
+    for (int k = 0; k < count; k++)
+    {
+        int slot = --fill[edges[k].src];
+        map->targets[slot] = edges[k].dest;
+        map->weights[slot] = edges[k].distance;
+        map->directions[slot] = edges[k].direction;
+    }
+    free(fill);
+    free(edges);
+    map->V = V;
+    map->E = count;
+    map->offsets = offsets;
+    map->pois = pois;
+    map->poiCount = poiCount;
+    return true;
+}
+
+
+void freeMapArrays(struct MapArrays *map)
+{
+    free(map->offsets);
+    free(map->targets);
+    free(map->weights);
+    free(map->directions);
+    free(map->pois);
+}
+
+
+// Turns a map file into a C header of static const CSR arrays that the
+// navigator compiles in with -DEMBEDDED_MAP.
+int embedMain(const char *mapFile, const char *headerFile)
+{
+    struct MapArrays map;
+    if (!readMapArrays(mapFile, &map))
+    {
+        return 1;
+    }
+    int *poiVertices = (int *)malloc((map.poiCount + 1) * sizeof(int));
+    if (!poiVertices)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    for (int k = 0; k < map.poiCount; k++)
+    {
+        poiVertices[k] = map.pois[k].vertex;
+    }
+
+    FILE *file = fopen(headerFile, "w");
+    if (!file)
+    {
+        perror("Failed to open the file for writing");
+        free(poiVertices);
+        freeMapArrays(&map);
+        return 1;
+    }
+    fprintf(file, "// Generated by MAP_MAKE embed from %s. Do not edit.\n\n", mapFile);
+    fprintf(file, "#define EMBEDDED_V %d\n", map.V);
+    fprintf(file, "#define EMBEDDED_E %d\n", map.E);
+    fprintf(file, "#define EMBEDDED_POIS %d\n\n", map.poiCount);
+    writeEmbeddedInts(file, "static const int embeddedOffsets[EMBEDDED_V + 1]", map.offsets, map.V + 1);
+    writeEmbeddedInts(file, "static const int embeddedTargets[EMBEDDED_E + 1]", map.targets, map.E);
+    writeEmbeddedInts(file, "static const int embeddedWeights[EMBEDDED_E + 1]", map.weights, map.E);
+    writeEmbeddedInts(file, "static const unsigned char embeddedDirections[EMBEDDED_E + 1]", map.directions, map.E);
+    writeEmbeddedInts(file, "static const int embeddedPoiVertices[EMBEDDED_POIS + 1]", poiVertices, map.poiCount);
+    fprintf(file, "static const char embeddedPoiTags[EMBEDDED_POIS + 1][32] = {");
+    for (int k = 0; k < map.poiCount; k++)
+    {
+        fprintf(file, "\n    ");
+        writeEmbeddedString(file, map.pois[k].tag);
+        fputc(',', file);
+    }
+    fprintf(file, map.poiCount ? "\n};\n" : "\"\"};\n");
     fclose(file);
+
+    printf("Embedded %d vertices, %d edges and %d points of interest into %s.\n", map.V, map.E, map.poiCount,
+           headerFile);
+    free(poiVertices);
+    freeMapArrays(&map);
+    return 0;
+}
+
+
+void writePadding(FILE *file, uint64_t *position)
+{
+    static const char zeros[8] = {0};
+    uint64_t padded = (*position + 7) / 8 * 8;
+    fwrite(zeros, 1, padded - *position, file);
+    *position = padded;
 }
 
 
-int main()
+// Writes a tiled map: vertices are renumbered in breadth-first order and cut
+// into tiles of tileVertices consecutive vertices, so a search that stays in
+// one region of the map only needs the few tiles covering it. Each tile is a
+// small CSR block the navigator pages in on demand.
+int tileMain(const char *mapFile, const char *tiledFile, int tileVertices)
 {
+    struct MapArrays map;
+    if (!readMapArrays(mapFile, &map))
+    {
+        return 1;
+    }
+    int V = map.V;
+    int *order = (int *)malloc((V + 1) * sizeof(int));
+    int *rank = (int *)malloc((V + 1) * sizeof(int));
+    if (!order || !rank)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    for (int v = 0; v < V; v++)
+    {
+        rank[v] = -1;
+    }
+    int tail = 0;
+    for (int start = 0; start < V; start++)
+    {
+        if (rank[start] != -1)
+        {
+            continue;
+        }
+        rank[start] = tail;
+        order[tail++] = start;
+        for (int head = tail - 1; head < tail; head++)
+        {
+            int u = order[head];
+            for (int k = map.offsets[u]; k < map.offsets[u + 1]; k++)
+            {
+                int v = map.targets[k];
+                if (rank[v] == -1)
+                {
+                    rank[v] = tail;
+                    order[tail++] = v;
+                }
+            }
+        }
+    }
+
+    FILE *file = fopen(tiledFile, "wb");
+    if (!file)
+    {
+        perror("Failed to open the file for writing");
+        free(order);
+        free(rank);
+        freeMapArrays(&map);
+        return 1;
+    }
+    int tileCount = (V + tileVertices - 1) / tileVertices;
+    struct TileEntry *directory = (struct TileEntry *)calloc(tileCount + 1, sizeof(struct TileEntry));
+    int32_t *block = (int32_t *)malloc((tileVertices + 1) * sizeof(int32_t));
+    if (!directory || !block)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+
+    struct TileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "MAPTILE1", 8);
+    header.V = (uint32_t)V;
+    header.tileVertices = (uint32_t)tileVertices;
+    header.tileCount = (uint32_t)tileCount;
+    header.poiCount = (uint32_t)map.poiCount;
+    header.E = (uint64_t)map.E;
+    uint64_t position = sizeof(header);
+    fwrite(&header, sizeof(header), 1, file);
+    header.externalPos = position;
+    for (int v = 0; v < V; v++)
+    {
+        int32_t external = order[v];
+        fwrite(&external, sizeof(int32_t), 1, file);
+    }
+    position += V * sizeof(int32_t);
+    writePadding(file, &position);
+    header.directoryPos = position;
+    fwrite(directory, sizeof(struct TileEntry), tileCount, file);
+    position += tileCount * sizeof(struct TileEntry);
+
+    size_t largest = 0;
+    for (int t = 0; t < tileCount; t++)
+    {
+        int first = t * tileVertices;
+        int count = V - first < tileVertices ? V - first : tileVertices;
+        block[0] = 0;
+        for (int k = 0; k < count; k++)
+        {
+            int u = order[first + k];
+            block[k + 1] = block[k] + map.offsets[u + 1] - map.offsets[u];
+        }
+        int edges = block[count];
+        directory[t].position = position;
+        directory[t].edges = (uint32_t)edges;
+        directory[t].size = (uint32_t)((count + 1) * sizeof(int32_t) + edges * (2 * sizeof(int32_t) + 1));
+        fwrite(block, sizeof(int32_t), count + 1, file);
+        for (int pass = 0; pass < 3; pass++)
+        {
+            for (int k = 0; k < count; k++)
+            {
+                int u = order[first + k];
+                for (int e = map.offsets[u]; e < map.offsets[u + 1]; e++)
+                {
+                    if (pass == 2)
+                    {
+                        unsigned char direction = (unsigned char)map.directions[e];
+                        fwrite(&direction, 1, 1, file);
+                    }
+                    else
+                    {
+                        int32_t value = pass == 0 ? rank[map.targets[e]] : map.weights[e];
+                        fwrite(&value, sizeof(int32_t), 1, file);
+                    }
+                }
+            }
+        }
+        position += directory[t].size;
+        writePadding(file, &position);
+        largest = directory[t].size > largest ? directory[t].size : largest;
+    }
+
+    header.poiPos = position;
+    for (int k = 0; k < map.poiCount; k++)
+    {
+        struct TilePoi poi;
+        memset(&poi, 0, sizeof(poi));
+        poi.vertex = map.pois[k].vertex;
+        strcpy(poi.tag, map.pois[k].tag);
+        fwrite(&poi, sizeof(poi), 1, file);
+    }
+    fseek(file, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, file);
+    fseek(file, (long)header.directoryPos, SEEK_SET);
+    fwrite(directory, sizeof(struct TileEntry), tileCount, file);
+    bool failed = ferror(file) != 0;
+    fclose(file);
+    if (failed)
+    {
+        fprintf(stderr, "Failed to write %s\n", tiledFile);
+    }
+    else
+    {
+        printf("Wrote %d vertices and %d edges as %d tiles of %d vertices (largest tile %zu bytes) to %s.\n", V,
+               map.E, tileCount, tileVertices, largest, tiledFile);
+    }
+    free(order);
+    free(rank);
+    free(directory);
+    free(block);
+    freeMapArrays(&map);
+    return failed ? 1 : 0;
+}
+
+
+struct ByteBuffer
+{
+    unsigned char *bytes;
+    size_t size;
+    size_t capacity;
+};
+
+
+void reserveBytes(struct ByteBuffer *buffer, size_t extra)
+{
+    if (buffer->size + extra > buffer->capacity)
+    {
+        while (buffer->size + extra > buffer->capacity)
+        {
+            buffer->capacity = buffer->capacity ? buffer->capacity * 2 : 4096;
+        }
+        buffer->bytes = (unsigned char *)realloc(buffer->bytes, buffer->capacity);
+        if (!buffer->bytes)
+        {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+
+void appendVarint(struct ByteBuffer *buffer, unsigned int value)
+{
+    reserveBytes(buffer, 5);
+    while (value >= 0x80)
+    {
+        buffer->bytes[buffer->size++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    buffer->bytes[buffer->size++] = (unsigned char)value;
+}
+
+
+// FNV-1a, enough to catch truncated or damaged blocks.
+uint32_t blockChecksum(const unsigned char *bytes, size_t size)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t k = 0; k < size; k++)
+    {
+        hash = (hash ^ bytes[k]) * 16777619u;
+    }
+    return hash;
+}
+
+
+int comparePackedEdge(const void *a, const void *b)
+{
+    const struct PackedEdge *x = (const struct PackedEdge *)a;
+    const struct PackedEdge *y = (const struct PackedEdge *)b;
+    if (x->dest != y->dest)
+    {
+        return x->dest < y->dest ? -1 : 1;
+    }
+    return x->code < y->code ? -1 : (x->code > y->code);
+}
+
+
+// Writes a packed map: blocks of PACK_BLOCK_VERTICES vertices, each holding
+// the block's directions at two bits per edge followed by, per vertex, its
+// degree and its edges sorted by target as varint target gaps and distances.
+// Every block carries its own checksum and decodes on its own.
+int packMain(const char *mapFile, const char *packedFile)
+{
+    struct MapArrays map;
+    if (!readMapArrays(mapFile, &map))
+    {
+        return 1;
+    }
+    int V = map.V;
+    int blockCount = (V + PACK_BLOCK_VERTICES - 1) / PACK_BLOCK_VERTICES;
+    struct PackBlock *directory = (struct PackBlock *)calloc(blockCount + 1, sizeof(struct PackBlock));
+    struct PackedEdge *edges = (struct PackedEdge *)malloc((map.E + 1) * sizeof(struct PackedEdge));
+    if (!directory || !edges)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    for (int k = 0; k < map.E; k++)
+    {
+        if (map.weights[k] < 0 || map.weights[k] >= (1 << 29))
+        {
+            fprintf(stderr, "An edge has a distance that cannot be packed.\n");
+            free(directory);
+            free(edges);
+            freeMapArrays(&map);
+            return 1;
+        }
+        edges[k].dest = map.targets[k];
+        edges[k].code = ((unsigned int)map.weights[k] << 2) | (unsigned int)map.directions[k];
+    }
+
+    FILE *file = fopen(packedFile, "wb");
+    if (!file)
+    {
+        perror("Failed to open the file for writing");
+        free(directory);
+        free(edges);
+        freeMapArrays(&map);
+        return 1;
+    }
+    struct PackHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "MAPPACK1", 8);
+    header.V = (uint32_t)V;
+    header.blockVertices = PACK_BLOCK_VERTICES;
+    header.blockCount = (uint32_t)blockCount;
+    header.poiCount = (uint32_t)map.poiCount;
+    header.E = (uint64_t)map.E;
+    header.directoryPos = sizeof(header);
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(directory, sizeof(struct PackBlock), blockCount, file);
+    uint64_t position = sizeof(header) + blockCount * sizeof(struct PackBlock);
+
+    struct ByteBuffer buffer = {NULL, 0, 0};
+    for (int b = 0; b < blockCount; b++)
+    {
+        int first = b * PACK_BLOCK_VERTICES;
+        int last = first + PACK_BLOCK_VERTICES < V ? first + PACK_BLOCK_VERTICES : V;
+        int blockEdges = map.offsets[last] - map.offsets[first];
+        buffer.size = 0;
+        reserveBytes(&buffer, (blockEdges + 3) / 4);
+        memset(buffer.bytes, 0, (blockEdges + 3) / 4);
+        buffer.size = (blockEdges + 3) / 4;
+        int e = 0;
+        for (int u = first; u < last; u++)
+        {
+            struct PackedEdge *list = edges + map.offsets[u];
+            int degree = map.offsets[u + 1] - map.offsets[u];
+            qsort(list, degree, sizeof(struct PackedEdge), comparePackedEdge);
+            appendVarint(&buffer, (unsigned int)degree);
+            for (int k = 0; k < degree; k++, e++)
+            {
+                if (k == 0)
+                {
+                    int delta = list[k].dest - u;
+                    appendVarint(&buffer, ((unsigned int)delta << 1) ^ (unsigned int)(delta >> 31));
+                }
+                else
+                {
+                    appendVarint(&buffer, (unsigned int)(list[k].dest - list[k - 1].dest));
+                }
+                appendVarint(&buffer, list[k].code >> 2);
+                buffer.bytes[e / 4] |= (unsigned char)((list[k].code & 3) << (2 * (e % 4)));
+            }
+        }
+        directory[b].position = position;
+        directory[b].size = (uint32_t)buffer.size;
+        directory[b].edges = (uint32_t)blockEdges;
+        directory[b].checksum = blockChecksum(buffer.bytes, buffer.size);
+        fwrite(buffer.bytes, 1, buffer.size, file);
+        position += buffer.size;
+    }
+
+    header.poiPos = position;
+    for (int k = 0; k < map.poiCount; k++)
+    {
+        struct TilePoi poi;
+        memset(&poi, 0, sizeof(poi));
+        poi.vertex = map.pois[k].vertex;
+        strcpy(poi.tag, map.pois[k].tag);
+        fwrite(&poi, sizeof(poi), 1, file);
+        position += sizeof(poi);
+    }
+    fseek(file, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(directory, sizeof(struct PackBlock), blockCount, file);
+    bool failed = ferror(file) != 0;
+    fclose(file);
+    if (failed)
+    {
+        fprintf(stderr, "Failed to write %s\n", packedFile);
+    }
+    else
+    {
+        printf("Packed %d vertices and %d edges into %d blocks, %llu bytes (%.2f bytes per edge) in %s.\n", V,
+               map.E, blockCount, (unsigned long long)position, map.E ? (double)position / map.E : 0.0,
+               packedFile);
+    }
+    free(buffer.bytes);
+    free(directory);
+    free(edges);
+    freeMapArrays(&map);
+    return failed ? 1 : 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1 && strcmp(argv[1], "import") == 0)
+    {
+        if (argc != 4)
+        {
+            fprintf(stderr, "Usage: %s import <edge-list|-> <map-file>\n", argv[0]);
+            return 1;
+        }
+        return importMain(argv[2], argv[3]);
+    }
+    if (argc > 1 && strcmp(argv[1], "embed") == 0)
+    {
+        if (argc != 4)
+        {
+            fprintf(stderr, "Usage: %s embed <map-file> <header-file>\n", argv[0]);
+            return 1;
+        }
+        return embedMain(argv[2], argv[3]);
+    }
+    if (argc > 1 && strcmp(argv[1], "pack") == 0)
+    {
+        if (argc != 4)
+        {
+            fprintf(stderr, "Usage: %s pack <map-file> <packed-file>\n", argv[0]);
+            return 1;
+        }
+        return packMain(argv[2], argv[3]);
+    }
+    if (argc > 1 && strcmp(argv[1], "tile") == 0)
+    {
+        int tileVertices = argc == 5 ? atoi(argv[4]) : 0;
+        if (argc != 5 || tileVertices <= 0)
+        {
+            fprintf(stderr, "Usage: %s tile <map-file> <tiled-file> <vertices-per-tile>\n", argv[0]);
+            return 1;
+        }
+        return tileMain(argv[2], argv[3], tileVertices);
+    }
+
     int V = 10; 
     struct Graph *graph = createGraph(V);
 
@@ -170,6 +1354,7 @@ int main()
         printf("2. Save map to file\n");
         printf("3. Print graph\n");
         printf("4. Exit\n");
+        printf("5. Tag a point of interest\n");
         printf("Enter your choice: ");
 
         int choice;
@@ -189,11 +1374,12 @@ int main()
         {
         case 1:
     {
-        int src, dest, distance;
+        long long src, dest;
+        int distance;
         enum Direction direction; 
         printf("Enter edge (source, destination, distance, and direction): ");
         char directionInput[10];
-        if (scanf("%d %d %d %s", &src, &dest, &distance, directionInput) != 4)
+        if (scanf("%lld %lld %d %9s", &src, &dest, &distance, directionInput) != 4)
         {
             printf("Invalid input for the edge.\n");
             continue;
@@ -235,11 +1421,27 @@ int main()
         case 4:
             {
                 printf("Exiting the Map Creator. Goodbye!\n");
-                free(graph->adjList);
-                free(graph);
+                freeGraph(graph);
                 return 0;
             }
 
+        case 5:
+            {
+                long long vertex;
+                char tag[32];
+                printf("Enter the vertex and its tag (e.g. 12 fuel): ");
+                if (scanf("%lld %31s", &vertex, tag) != 2)
+                {
+                    printf("Invalid input for the point of interest.\n");
+                    break;
+                }
+                if (!addPointOfInterest(graph, vertex, tag))
+                {
+                    printf("Invalid input for the vertex.\n");
+                }
+                break;
+            }
+
         default:
             {
                 printf("Invalid choice. Please enter a valid option.\n");
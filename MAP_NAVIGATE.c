@@ -2,6 +2,20 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 
 enum Direction {
     RIGHT,
@@ -10,310 +24,8369 @@ enum Direction {
     BACK
 };
 
+#ifdef EMBEDDED_MAP
+#include "embedded_map.h"
+#endif
+
+#define PROFILE_PERIOD 1440
+#define CURSOR_BUFFER 4
+#define TILE_CACHE_MB 64
+#define ALT_STRETCH 0.25
+#define ALT_SHARING 0.8
+#define ALT_LOCAL 0.25
+#define ALT_CANDIDATES 64
+#define MAX_ALTERNATIVES 3
+#define VORONOI_PARALLEL_MIN 100000
+#define VORONOI_CHUNK 256
+#define BETWEENNESS_FAILURE 0.05
+#define ADJACENCY_BLOCK 4096
+
 struct Node
 {
     int data;
     int distance;
     enum Direction direction;
+    int profile;
     struct Node *next;
 };
 
 
-struct Graph
+struct CompressedAdjacency
+{
+    int E;
+    unsigned int *offsets;
+    unsigned char *bytes;
+    size_t size;
+    size_t capacity;
+};
+
+
+struct TileHeader
+{
+    char magic[8];
+    uint32_t V;
+    uint32_t tileVertices;
+    uint32_t tileCount;
+    uint32_t poiCount;
+    uint64_t E;
+    uint64_t externalPos;
+    uint64_t directoryPos;
+    uint64_t poiPos;
+};
+
+
+struct TileEntry
+{
+    uint64_t position;
+    uint32_t size;
+    uint32_t edges;
+};
+
+
+struct TilePoi
+{
+    int32_t vertex;
+    char tag[32];
+};
+
+
+struct Tile
+{
+    unsigned char *block;
+    const int32_t *offsets;
+    const int32_t *targets;
+    const int32_t *weights;
+    const unsigned char *directions;
+    int prev;
+    int next;
+};
+
+
+// Tiles are paged in from fd on demand and kept on an LRU list (head is the
+// most recently used) until the resident bytes would exceed cacheBytes.
+struct TiledMap
+{
+    int fd;
+    int V;
+    long long E;
+    int tileVertices;
+    int tileCount;
+    struct TileEntry *directory;
+    struct Tile *tile;
+    int head;
+    int tail;
+    size_t resident;
+    size_t cacheBytes;
+    long long loads;
+    long long evictions;
+    pthread_mutex_t lock;
+};
+
+
+struct ConnectivityIndex
+{
+    int components;
+    int *component;
+    int *dagOffsets;
+    int *dagTargets;
+    int *low[2];
+    int *post[2];
+};
+
+
+struct ProfilePool
+{
+    int count;
+    int capacity;
+    int *offsets;
+    int *times;
+    int *values;
+    int pointCapacity;
+    int *buckets;
+    int bucketCount;
+};
+
+
+// Sparse maps name their vertices with arbitrary 64-bit IDs; they are
+// interned in the order they are first seen, and the resulting dense IDs are
+// the external vertex IDs everything else works with.
+struct IdTable
+{
+    int count;
+    int capacity;
+    long long *key;
+    int *slot;
+    size_t slotMask;
+};
+
+
+struct Graph
+{
+    int V;
+    struct Node ***adjList;
+    struct CompressedAdjacency *compressed;
+    struct TiledMap *tiles;
+    _Atomic(struct ConnectivityIndex *) connectivity;
+    atomic_bool connectivityStale;
+    struct HubLabels *hubLabels;
+    struct Overlay *overlay;
+    struct ChainContraction *chains;
+    struct ProfilePool *profiles;
+    struct RangeIndex *range;
+    struct PoiIndex *pois;
+    struct IdTable *ids;
+    int *order;
+    int *rank;
+};
+
+
+struct EdgeCursor
+{
+    struct Node *node;
+    const unsigned char *pos;
+    const unsigned char *end;
+    int target;
+    int edge;
+    int last;
+    struct TiledMap *tiles;
+    int tile;
+    int buffered;
+    int next;
+    int bufferTarget[CURSOR_BUFFER];
+    int bufferDistance[CURSOR_BUFFER];
+    unsigned char bufferDirection[CURSOR_BUFFER];
+};
+
+
+#define MAX_MAP_READERS 4
+
+struct MemoryReport
+{
+    long long edges;
+    size_t graph;
+    size_t vertexArray;
+    size_t edgeNodes;
+    size_t nodeOverhead;
+    size_t compressed;
+    size_t embedded;
+    size_t tiles;
+    size_t order;
+    size_t ids;
+    size_t connectivity;
+    size_t hubLabels;
+    size_t hubLabelsMapped;
+    size_t overlay;
+    size_t chains;
+    size_t profiles;
+    size_t rangeIndex;
+    size_t pois;
+    size_t workspace;
+    size_t total;
+};
+
+
+struct RetiredGraph
+{
+    struct Graph *graph;
+    unsigned int epoch;
+    bool sharesLists;
+    bool sharesOrder;
+    bool sharesIds;
+    bool sharesConnectivity;
+    struct Node **superseded;
+    int supersededCount;
+    int supersededCapacity;
+    struct Node ***supersededBlocks;
+    int supersededBlockCount;
+    struct RetiredGraph *next;
+};
+
+
+struct MapHandle
+{
+    _Atomic(struct Graph *) current;
+    atomic_uint epoch;
+    atomic_uint readers[MAX_MAP_READERS];
+    atomic_bool stopping;
+    struct RetiredGraph *retired;
+    pthread_mutex_t lock;
+    pthread_mutex_t writer;
+    pthread_t watcher;
+    bool compressed;
+    size_t tileCache;
+    char filename[256];
+    char pendingFile[256];
+};
+
+
+struct StagedEdge
+{
+    long long srcId;
+    long long destId;
+    int src;
+    int dest;
+    int distance;
+    enum Direction direction;
+    int sequence;
+};
+
+
+struct MapEditor
+{
+    struct StagedEdge *edits;
+    int count;
+    int capacity;
+};
+
+
+struct BackgroundBatch
+{
+    struct MapHandle *map;
+    struct Graph *graph;
+    char queryFile[256];
+    char resultFile[256];
+    pthread_t thread;
+    atomic_bool running;
+    bool started;
+};
+
+
+struct HeapEntry
+{
+    int key;
+    int order;
+    int vertex;
+};
+
+
+struct MinHeap
+{
+    int size;
+    int capacity;
+    struct HeapEntry *entries;
+};
+
+
+struct SearchWorkspace
+{
+    int *distance;
+    int *parent;
+    bool *visited;
+    int *path;
+    unsigned int *stamp;
+    unsigned int generation;
+    int V;
+    struct MinHeap *heap;
+    struct RouteTree *forwardTree;
+    struct RouteTree *backwardTree;
+};
+
+
+struct TightEdge
+{
+    int from;
+    enum Direction direction;
+    int next;
+};
+
+
+struct ShortestPathDag
+{
+    int *head;
+    unsigned long long *count;
+    struct TightEdge *edges;
+    int edgeCount;
+    int edgeCapacity;
+};
+
+
+#define BATCH_WINDOW 4096
+
+struct QueryBatch
+{
+    struct Graph *graph;
+    long long *queries;
+    int count;
+    int next;
+    int written;
+    char **results;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    pthread_cond_t space;
+};
+
+
+struct BatchWorker
+{
+    struct QueryBatch *batch;
+    struct SearchWorkspace *workspace;
+};
+
+
+struct CSRGraph
+{
+    int V;
+    int E;
+    int *offsets;
+    int *targets;
+    int *weights;
+    unsigned char *directions;
+};
+
+
+struct RangeIndex
+{
+    struct CSRGraph *forward;
+    struct CSRGraph *reverse;
+};
+
+
+struct RouteTree
+{
+    int *distance;
+    int *parent;
+    int *parentEdge;
+    int *settled;
+    int settledCount;
+    unsigned int *reached;
+    unsigned int *done;
+    unsigned int generation;
+    int V;
+};
+
+
+struct ViaCandidate
+{
+    int vertex;
+    long long score;
+};
+
+
+struct VoronoiBucket
+{
+    int *vertices;
+    int count;
+    int capacity;
+};
+
+
+// Shared state of the parallel nearest-facility search. buckets[t][b] holds
+// the vertices thread t reached at a distance in bucket b; the threads work
+// through one bucket at a time and meet at the barrier between phases.
+struct VoronoiSearch
+{
+    struct CSRGraph *csr;
+    _Atomic unsigned long long *label;
+    int threads;
+    int delta;
+    int bucket;
+    bool done;
+    int *current;
+    int currentCount;
+    int currentCapacity;
+    atomic_int next;
+    struct VoronoiBucket **buckets;
+    int *bucketSize;
+    pthread_barrier_t barrier;
+};
+
+
+struct VoronoiWorker
+{
+    struct VoronoiSearch *search;
+    int id;
+};
+
+
+struct BetweennessJob
+{
+    struct CSRGraph *csr;
+    int *sources;
+    int sourceCount;
+    atomic_int next;
+};
+
+
+// One thread's search arrays and its share of the scores, which are summed
+// once every source has been processed.
+struct BetweennessWorker
+{
+    struct BetweennessJob *job;
+    int *distance;
+    double *sigma;
+    double *dependency;
+    int *position;
+    int *settled;
+    struct MinHeap *heap;
+    double *vertexScore;
+    double *edgeScore;
+};
+
+
+struct RankedScore
+{
+    int index;
+    double score;
+};
+
+
+// Reduced graph with every maximal chain of pass-through vertices replaced by
+// one edge. A reduced edge's steps are the original vertices it passes, in
+// order, each with the distance and direction of the edge that reaches it.
+struct ChainContraction
+{
+    int *reduced;
+    int *original;
+    struct CSRGraph *graph;
+    int *stepOffsets;
+    int *stepVertex;
+    int *stepDistance;
+    unsigned char *stepDirection;
+    int *place;
+};
+
+
+struct ParetoLabel
+{
+    int vertex;
+    int distance;
+    int turns;
+    int parent;
+    enum Direction direction;
+};
+
+
+struct PoiIndex
+{
+    int count;
+    int capacity;
+    int *vertex;
+    int *tag;
+    int *next;
+    int *first;
+    int tagCount;
+    int tagCapacity;
+    char (*tagNames)[32];
+    int nearestK;
+    int nearestTag;
+    int *nearest;
+    int *nearestDistance;
+};
+
+
+struct PoiLabels
+{
+    int count;
+    int capacity;
+    int *vertex;
+    int *poi;
+};
+
+
+struct LabelList
+{
+    int count;
+    int capacity;
+    int *hubs;
+    int *distances;
+    int *parents;
+};
+
+
+struct LabelWorkspace
+{
+    int *distance;
+    int *parent;
+    int *hubDistance;
+    int *touched;
+    struct MinHeap *heap;
+};
+
+
+struct LabelBuilder
+{
+    struct CSRGraph *forward;
+    struct CSRGraph *backward;
+    int *rankToVertex;
+    struct LabelList *in;
+    struct LabelList *out;
+    struct LabelList *tasks;
+    int batchStart;
+    int taskCount;
+    atomic_int nextTask;
+    bool finished;
+    pthread_barrier_t start;
+    pthread_barrier_t done;
+};
+
+
+struct LabelWorker
+{
+    struct LabelBuilder *builder;
+    struct LabelWorkspace workspace;
+};
+
+
+struct HubLabelHeader
+{
+    char magic[8];
+    uint32_t V;
+    uint32_t flags;
+    uint64_t externalPos;
+    uint64_t hubVertexPos;
+    uint64_t outOffsetsPos;
+    uint64_t inOffsetsPos;
+    uint64_t dataPos;
+    uint64_t dataSize;
+};
+
+
+struct HubLabels
+{
+    void *map;
+    size_t mapSize;
+    int V;
+    bool parents;
+    const int32_t *external;
+    const uint32_t *hubVertex;
+    const uint64_t *outOffsets;
+    const uint64_t *inOffsets;
+    const unsigned char *data;
+    int *fileIndex;
+};
+
+
+struct LabelCursor
+{
+    const unsigned char *pos;
+    const unsigned char *end;
+    bool parents;
+    int hub;
+    int distance;
+    int parent;
+};
+
+
+struct OverlayLevel
+{
+    int cellCount;
+    int *cell;
+    int *entryOffsets;
+    int *entries;
+    int *exitOffsets;
+    int *exits;
+    int *entryIndex;
+    int *exitIndex;
+    long long *matrixOffsets;
+    int *weights;
+    bool *dirty;
+};
+
+
+struct Overlay
+{
+    int levels;
+    struct OverlayLevel *level;
+    struct CSRGraph *forward;
+};
+
+
+struct OverlayWorkspace
+{
+    int *distance;
+    int *parent;
+    signed char *parentLevel;
+    int *touched;
+    int touchedCount;
+    struct MinHeap *heap;
+};
+
+
+struct CustomizeTask
+{
+    struct Overlay *overlay;
+    int level;
+    atomic_int *nextCell;
+};
+
+
+struct TarjanFrame
+{
+    int vertex;
+    struct EdgeCursor cursor;
+};
+
+
+struct PackedEdge
+{
+    int src;
+    int dest;
+    unsigned int weight;
+};
+
+
+struct PackHeader
+{
+    char magic[8];
+    uint32_t V;
+    uint32_t blockVertices;
+    uint32_t blockCount;
+    uint32_t poiCount;
+    uint64_t E;
+    uint64_t directoryPos;
+    uint64_t poiPos;
+};
+
+
+struct PackBlock
+{
+    uint64_t position;
+    uint32_t size;
+    uint32_t edges;
+    uint32_t checksum;
+    uint32_t reserved;
+};
+
+
+struct PackTask
+{
+    const unsigned char *data;
+    const struct PackHeader *header;
+    const struct PackBlock *directory;
+    const long long *edgeStart;
+    struct PackedEdge *edges;
+    struct Graph *graph;
+    bool lists;
+    atomic_int *nextBlock;
+    atomic_int *corrupt;
+};
+
+
+enum VertexOrdering {
+    ORDER_BFS,
+    ORDER_RCM
+};
+
+
+struct VertexDegree
+{
+    int degree;
+    int vertex;
+};
+
+
+struct Node *createNode(int data, int distance, enum Direction direction)
+{
+    struct Node *newNode = (struct Node *)malloc(sizeof(struct Node));
+    if (!newNode)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    newNode->data = data;
+    newNode->distance = distance;
+    newNode->direction = direction;
+    newNode->profile = -1;
+    newNode->next = NULL;
+    return newNode;
+}
+
+
+// Vertex pointers live in fixed-size blocks, so a snapshot can copy only the
+// blocks whose lists it changes and share the rest with the one it replaces.
+int adjacencyBlocks(int V)
+{
+    return (V + ADJACENCY_BLOCK - 1) / ADJACENCY_BLOCK;
+}
+
+
+struct Node **createAdjacencyBlock(void)
+{
+    struct Node **block = (struct Node **)calloc(ADJACENCY_BLOCK, sizeof(struct Node *));
+    if (!block)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    return block;
+}
+
+
+// Makes room for vertices from..to-1, e.g. as a sparse map interns new IDs.
+struct Node ***growAdjacency(struct Node ***adjList, int from, int to)
+{
+    adjList = (struct Node ***)realloc(adjList, (adjacencyBlocks(to) + 1) * sizeof(struct Node **));
+    if (!adjList)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    for (int b = adjacencyBlocks(from); b < adjacencyBlocks(to); b++)
+    {
+        adjList[b] = createAdjacencyBlock();
+    }
+    return adjList;
+}
+
+
+void freeAdjacency(struct Node ***adjList, int V)
+{
+    for (int b = 0; adjList && b < adjacencyBlocks(V); b++)
+    {
+        free(adjList[b]);
+    }
+    free(adjList);
+}
+
+
+struct Node **adjacencySlot(struct Node ***adjList, int u)
+{
+    return &adjList[u / ADJACENCY_BLOCK][u % ADJACENCY_BLOCK];
+}
+
+
+struct Graph *createGraph(int V)
+{
+    struct Graph *graph = (struct Graph *)malloc(sizeof(struct Graph));
+    if (!graph)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    graph->V = V;
+    graph->adjList = growAdjacency(NULL, 0, V);
+    graph->compressed = NULL;
+    graph->tiles = NULL;
+    atomic_init(&graph->connectivity, NULL);
+    atomic_init(&graph->connectivityStale, false);
+    graph->hubLabels = NULL;
+    graph->overlay = NULL;
+    graph->chains = NULL;
+    graph->profiles = NULL;
+    graph->range = NULL;
+    graph->pois = NULL;
+    graph->ids = NULL;
+    graph->order = NULL;
+    graph->rank = NULL;
+    return graph;
+}
+
+
+int toInternal(struct Graph *graph, int vertex)
+{
+    return graph->rank ? graph->rank[vertex] : vertex;
+}
+
+
+int toExternal(struct Graph *graph, int vertex)
+{
+    return graph->order ? graph->order[vertex] : vertex;
+}
+
+
+struct IdTable *createIdTable(void)
+{
+    struct IdTable *ids = (struct IdTable *)calloc(1, sizeof(struct IdTable));
+    if (!ids)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    ids->slotMask = 1023;
+    ids->slot = (int *)calloc(ids->slotMask + 1, sizeof(int));
+    if (!ids->slot)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    return ids;
+}
+
+
+void freeIdTable(struct IdTable *ids)
+{
+    if (ids)
+    {
+        free(ids->key);
+        free(ids->slot);
+        free(ids);
+    }
+}
+
+
+size_t hashId(long long id)
+{
+    unsigned long long key = (unsigned long long)id + 0x9e3779b97f4a7c15ULL;
+    key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    key = (key ^ (key >> 27)) * 0x94d049bb133111ebULL;
+    return (size_t)(key ^ (key >> 31));
+}
+
+
+// Open addressing with linear probing; a slot holds dense ID + 1, 0 if empty.
+int *findIdSlot(struct IdTable *ids, long long id)
+{
+    size_t slot = hashId(id) & ids->slotMask;
+    while (ids->slot[slot] && ids->key[ids->slot[slot] - 1] != id)
+    {
+        slot = (slot + 1) & ids->slotMask;
+    }
+    return &ids->slot[slot];
+}
+
+
+int findId(struct IdTable *ids, long long id)
+{
+    return *findIdSlot(ids, id) - 1;
+}
+
+
+int internId(struct IdTable *ids, long long id)
+{
+    int *slot = findIdSlot(ids, id);
+    if (*slot)
+    {
+        return *slot - 1;
+    }
+    if (ids->count == ids->capacity)
+    {
+        ids->capacity = ids->capacity ? ids->capacity * 2 : 1024;
+        ids->key = (long long *)realloc(ids->key, ids->capacity * sizeof(long long));
+        if (!ids->key)
+        {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    ids->key[ids->count] = id;
+    *slot = ++ids->count;
+
+    if ((size_t)ids->count * 2 > ids->slotMask + 1)
+    {
+        free(ids->slot);
+        ids->slotMask = ids->slotMask * 2 + 1;
+        ids->slot = (int *)calloc(ids->slotMask + 1, sizeof(int));
+        if (!ids->slot)
+        {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+        for (int v = 0; v < ids->count; v++)
+        {
+            *findIdSlot(ids, ids->key[v]) = v + 1;
+        }
+    }
+    return ids->count - 1;
+}
+
+
+struct IdTable *copyIdTable(struct IdTable *ids)
+{
+    struct IdTable *copy = (struct IdTable *)malloc(sizeof(struct IdTable));
+    if (!copy)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    *copy = *ids;
+    copy->key = (long long *)malloc((ids->capacity + 1) * sizeof(long long));
+    copy->slot = (int *)malloc((ids->slotMask + 1) * sizeof(int));
+    if (!copy->key || !copy->slot)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(copy->key, ids->key, ids->count * sizeof(long long));
+    memcpy(copy->slot, ids->slot, (ids->slotMask + 1) * sizeof(int));
+    return copy;
+}
+
+
+// The ID a user sees for an external vertex, and back; -1 if not on the map.
+long long mapId(struct Graph *graph, int vertex)
+{
+    return graph->ids ? graph->ids->key[vertex] : vertex;
+}
+
+
+int denseId(struct Graph *graph, long long id)
+{
+    if (graph->ids)
+    {
+        return findId(graph->ids, id);
+    }
+    return id >= 0 && id < graph->V ? (int)id : -1;
+}
+
+
+// The ID a user sees for an internal vertex.
+long long vertexId(struct Graph *graph, int vertex)
+{
+    return mapId(graph, toExternal(graph, vertex));
+}
+
+
+// Reads a vertex ID typed at the menu; unknown IDs become -1.
+bool scanVertex(struct Graph *graph, int *vertex)
+{
+    long long id;
+    if (scanf("%lld", &id) != 1)
+    {
+        return false;
+    }
+    *vertex = denseId(graph, id);
+    return true;
+}
+
+
+bool parseDirection(const char *directionStr, enum Direction *direction)
+{
+    if (strcmp(directionStr, "right") == 0) {
+        *direction = RIGHT;
+    } else if (strcmp(directionStr, "left") == 0) {
+        *direction = LEFT;
+    } else if (strcmp(directionStr, "straight") == 0) {
+        *direction = STRAIGHT;
+    } else if (strcmp(directionStr, "back") == 0) {
+        *direction = BACK;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+
+const char *directionName(enum Direction direction)
+{
+    switch (direction) {
+        case RIGHT:
+            return "right";
+        case LEFT:
+            return "left";
+        case STRAIGHT:
+            return "straight";
+        case BACK:
+            return "back";
+    }
+    return "unknown";
+}
+
+
+// Compressed adjacency: each vertex's edges are sorted by target and stored
+// as varints. The first target is zig-zag coded relative to the vertex itself
+// (small after reordering), later ones as gaps from the previous target, and
+// the weight word carries the distance with the direction in its low 2 bits.
+struct CompressedAdjacency *createCompressedAdjacency(int V)
+{
+    struct CompressedAdjacency *compressed = (struct CompressedAdjacency *)malloc(sizeof(struct CompressedAdjacency));
+    if (!compressed)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    compressed->E = 0;
+    compressed->offsets = (unsigned int *)calloc(V + 1, sizeof(unsigned int));
+    compressed->capacity = 1024;
+    compressed->bytes = (unsigned char *)malloc(compressed->capacity);
+    compressed->size = 0;
+    if (!compressed->offsets || !compressed->bytes)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    return compressed;
+}
+
+
+void appendVarint(struct CompressedAdjacency *compressed, unsigned int value)
+{
+    if (compressed->size + 5 > compressed->capacity)
+    {
+        compressed->capacity *= 2;
+        compressed->bytes = (unsigned char *)realloc(compressed->bytes, compressed->capacity);
+        if (!compressed->bytes)
+        {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    while (value >= 0x80)
+    {
+        compressed->bytes[compressed->size++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    compressed->bytes[compressed->size++] = (unsigned char)value;
+}
+
+
+unsigned int readVarint(const unsigned char **pos)
+{
+    unsigned int value = 0;
+    int shift = 0;
+    unsigned char byte;
+    do
+    {
+        byte = *(*pos)++;
+        value |= (unsigned int)(byte & 0x7F) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    return value;
+}
+
+
+bool packEdge(int src, int dest, int distance, enum Direction direction, struct PackedEdge *edge)
+{
+    if (distance < 0 || distance >= (1 << 29))
+    {
+        return false;
+    }
+    edge->src = src;
+    edge->dest = dest;
+    edge->weight = ((unsigned int)distance << 2) | (unsigned int)direction;
+    return true;
+}
+
+
+int comparePackedEdge(const void *a, const void *b)
+{
+    const struct PackedEdge *x = (const struct PackedEdge *)a;
+    const struct PackedEdge *y = (const struct PackedEdge *)b;
+    if (x->src != y->src)
+    {
+        return x->src < y->src ? -1 : 1;
+    }
+    if (x->dest != y->dest)
+    {
+        return x->dest < y->dest ? -1 : 1;
+    }
+    return x->weight < y->weight ? -1 : (x->weight > y->weight);
+}
+
+
+// Appends the sorted edges of vertex u; vertices must be encoded in order.
+void encodeVertexEdges(struct CompressedAdjacency *compressed, int u, struct PackedEdge *edges, int count)
+{
+    int previous = u;
+    for (int k = 0; k < count; k++)
+    {
+        if (k == 0)
+        {
+            int delta = edges[k].dest - u;
+            appendVarint(compressed, ((unsigned int)delta << 1) ^ (unsigned int)(delta >> 31));
+        }
+        else
+        {
+            appendVarint(compressed, (unsigned int)(edges[k].dest - previous));
+        }
+        appendVarint(compressed, edges[k].weight);
+        previous = edges[k].dest;
+    }
+    compressed->E += count;
+    compressed->offsets[u + 1] = (unsigned int)compressed->size;
+}
+
+
+bool readAt(int fd, void *buffer, size_t size, uint64_t position)
+{
+    unsigned char *bytes = (unsigned char *)buffer;
+    while (size > 0)
+    {
+        ssize_t got = pread(fd, bytes, size, (off_t)position);
+        if (got <= 0)
+        {
+            return false;
+        }
+        bytes += got;
+        size -= (size_t)got;
+        position += (uint64_t)got;
+    }
+    return true;
+}
+
+
+void unlinkTile(struct TiledMap *tiles, int t)
+{
+    struct Tile *tile = &tiles->tile[t];
+    if (tile->prev != -1)
+    {
+        tiles->tile[tile->prev].next = tile->next;
+    }
+    else
+    {
+        tiles->head = tile->next;
+    }
+    if (tile->next != -1)
+    {
+        tiles->tile[tile->next].prev = tile->prev;
+    }
+    else
+    {
+        tiles->tail = tile->prev;
+    }
+}
+
+
+// The number of vertices in tile t; the last tile may be short.
+int tileVertexCount(const struct TiledMap *tiles, int t)
+{
+    int first = t * tiles->tileVertices;
+    return tiles->V - first < tiles->tileVertices ? tiles->V - first : tiles->tileVertices;
+}
+
+
+// The directory entry of tile t gives exactly the size its counts imply.
+bool validTileSize(const struct TiledMap *tiles, int t)
+{
+    const struct TileEntry *entry = &tiles->directory[t];
+    uint64_t edges = entry->edges;
+    return edges <= INT_MAX &&
+           entry->size == ((uint64_t)tileVertexCount(tiles, t) + 1 + 2 * edges) * sizeof(int32_t) + edges;
+}
+
+
+// Checks a tile block as it is paged in: the offsets run from 0 up to the
+// tile's edge count without going back and every target and direction is in
+// range.
+bool validTile(const struct TiledMap *tiles, int t, const unsigned char *block)
+{
+    const struct TileEntry *entry = &tiles->directory[t];
+    int count = tileVertexCount(tiles, t);
+    uint64_t edges = entry->edges;
+    if (!validTileSize(tiles, t))
+    {
+        return false;
+    }
+    const int32_t *offsets = (const int32_t *)block;
+    const int32_t *targets = offsets + count + 1;
+    const unsigned char *directions = (const unsigned char *)(targets + 2 * edges);
+    if (offsets[0] != 0 || offsets[count] != (int32_t)edges)
+    {
+        return false;
+    }
+    for (int k = 0; k < count; k++)
+    {
+        if (offsets[k + 1] < offsets[k])
+        {
+            return false;
+        }
+    }
+    for (uint64_t e = 0; e < edges; e++)
+    {
+        if (targets[e] < 0 || targets[e] >= tiles->V || directions[e] > 3)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// Makes tile t resident and the most recently used, evicting from the tail
+// while it would not fit under the cap. Called with the lock held.
+struct Tile *residentTile(struct TiledMap *tiles, int t)
+{
+    struct Tile *tile = &tiles->tile[t];
+    if (tile->block)
+    {
+        unlinkTile(tiles, t);
+    }
+    else
+    {
+        size_t size = tiles->directory[t].size;
+        while (tiles->tail != -1 && tiles->resident + size > tiles->cacheBytes)
+        {
+            int old = tiles->tail;
+            unlinkTile(tiles, old);
+            free(tiles->tile[old].block);
+            tiles->tile[old].block = NULL;
+            tiles->resident -= tiles->directory[old].size;
+            tiles->evictions++;
+        }
+        tile->block = (unsigned char *)malloc(size + 1);
+        if (!tile->block)
+        {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+        if (!readAt(tiles->fd, tile->block, size, tiles->directory[t].position))
+        {
+            perror("Failed to read a map tile");
+            exit(EXIT_FAILURE);
+        }
+        if (!validTile(tiles, t, tile->block))
+        {
+            printf("Map tile %d is damaged.\n", t);
+            exit(EXIT_FAILURE);
+        }
+        int count = tileVertexCount(tiles, t);
+        int edges = (int)tiles->directory[t].edges;
+        tile->offsets = (const int32_t *)tile->block;
+        tile->targets = tile->offsets + count + 1;
+        tile->weights = tile->targets + edges;
+        tile->directions = (const unsigned char *)(tile->weights + edges);
+        tiles->resident += size;
+        tiles->loads++;
+    }
+    tile->prev = -1;
+    tile->next = tiles->head;
+    if (tiles->head != -1)
+    {
+        tiles->tile[tiles->head].prev = t;
+    }
+    tiles->head = t;
+    if (tiles->tail == -1)
+    {
+        tiles->tail = t;
+    }
+    return tile;
+}
+
+
+// Copies the next few edges of the cursor's vertex out of its tile, so the
+// tile may be evicted while the cursor is still in use.
+void fillTileCursor(struct EdgeCursor *cursor)
+{
+    struct TiledMap *tiles = cursor->tiles;
+    pthread_mutex_lock(&tiles->lock);
+    struct Tile *tile = residentTile(tiles, cursor->tile);
+    if (cursor->last < 0)
+    {
+        // target holds the vertex's index within its tile until the first fill
+        cursor->edge = tile->offsets[cursor->target];
+        cursor->last = tile->offsets[cursor->target + 1];
+    }
+    cursor->buffered = 0;
+    cursor->next = 0;
+    while (cursor->edge < cursor->last && cursor->buffered < CURSOR_BUFFER)
+    {
+        cursor->bufferTarget[cursor->buffered] = tile->targets[cursor->edge];
+        cursor->bufferDistance[cursor->buffered] = tile->weights[cursor->edge];
+        cursor->bufferDirection[cursor->buffered] = tile->directions[cursor->edge];
+        cursor->buffered++;
+        cursor->edge++;
+    }
+    pthread_mutex_unlock(&tiles->lock);
+}
+
+
+void freeTiledMap(struct TiledMap *tiles)
+{
+    if (!tiles)
+    {
+        return;
+    }
+    for (int t = 0; t < tiles->tileCount; t++)
+    {
+        free(tiles->tile[t].block);
+    }
+    close(tiles->fd);
+    free(tiles->tile);
+    free(tiles->directory);
+    pthread_mutex_destroy(&tiles->lock);
+    free(tiles);
+}
+
+
+#ifdef EMBEDDED_MAP
+// An embedded map is the only adjacency the navigator can hold, so the cursor
+// reads the compiled-in arrays directly.
+void firstEdge(struct Graph *graph, int u, struct EdgeCursor *cursor)
+{
+    (void)graph;
+    cursor->edge = embeddedOffsets[u];
+    cursor->last = embeddedOffsets[u + 1];
+}
+
+
+bool nextEdge(struct EdgeCursor *cursor, int *dest, int *distance, enum Direction *direction)
+{
+    if (cursor->edge == cursor->last)
+    {
+        return false;
+    }
+    *dest = embeddedTargets[cursor->edge];
+    *distance = embeddedWeights[cursor->edge];
+    *direction = (enum Direction)embeddedDirections[cursor->edge];
+    cursor->edge++;
+    return true;
+}
+#else
+void firstEdge(struct Graph *graph, int u, struct EdgeCursor *cursor)
+{
+    cursor->tiles = graph->tiles;
+    if (graph->tiles)
+    {
+        cursor->node = NULL;
+        cursor->tile = u / graph->tiles->tileVertices;
+        cursor->target = u % graph->tiles->tileVertices;
+        cursor->last = -1;
+        fillTileCursor(cursor);
+    }
+    else if (graph->compressed)
+    {
+        cursor->node = NULL;
+        cursor->pos = graph->compressed->bytes + graph->compressed->offsets[u];
+        cursor->end = graph->compressed->bytes + graph->compressed->offsets[u + 1];
+        cursor->target = -u - 1;
+    }
+    else
+    {
+        cursor->node = *adjacencySlot(graph->adjList, u);
+        cursor->pos = NULL;
+        cursor->end = NULL;
+        cursor->target = u;
+    }
+}
+
+
+bool nextEdge(struct EdgeCursor *cursor, int *dest, int *distance, enum Direction *direction)
+{
+    if (cursor->node)
+    {
+        *dest = cursor->node->data;
+        *distance = cursor->node->distance;
+        *direction = cursor->node->direction;
+        cursor->node = cursor->node->next;
+        return true;
+    }
+    if (cursor->tiles)
+    {
+        if (cursor->next == cursor->buffered)
+        {
+            if (cursor->edge == cursor->last)
+            {
+                return false;
+            }
+            fillTileCursor(cursor);
+        }
+        int k = cursor->next++;
+        *dest = cursor->bufferTarget[k];
+        *distance = cursor->bufferDistance[k];
+        *direction = (enum Direction)cursor->bufferDirection[k];
+        return true;
+    }
+    if (cursor->pos == cursor->end)
+    {
+        return false;
+    }
+
+    unsigned int delta = readVarint(&cursor->pos);
+    if (cursor->target < 0)
+    {
+        // target holds -(u + 1) until the first edge has been decoded
+        cursor->target = -cursor->target - 1;
+        cursor->target += (int)(delta >> 1) ^ -(int)(delta & 1);
+    }
+    else
+    {
+        cursor->target += (int)delta;
+    }
+    unsigned int weight = readVarint(&cursor->pos);
+    *dest = cursor->target;
+    *distance = (int)(weight >> 2);
+    *direction = (enum Direction)(weight & 3);
+    return true;
+}
+#endif
+
+
+bool findEdge(struct Graph *graph, int src, int dest, int *distance, enum Direction *direction)
+{
+    struct EdgeCursor cursor;
+    int target;
+    firstEdge(graph, src, &cursor);
+    while (nextEdge(&cursor, &target, distance, direction))
+    {
+        if (target == dest)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+void compressGraph(struct Graph *graph)
+{
+    if (graph->profiles)
+    {
+        printf("Travel-time profiles are loaded; the compressed adjacency cannot keep them.\n");
+        return;
+    }
+
+    struct CompressedAdjacency *compressed = createCompressedAdjacency(graph->V);
+    size_t listBytes = graph->V * sizeof(struct Node *);
+    int capacity = 16;
+    struct PackedEdge *edges = (struct PackedEdge *)malloc(capacity * sizeof(struct PackedEdge));
+    if (!edges)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int u = 0; u < graph->V; u++)
+    {
+        int count = 0;
+        for (struct Node *temp = *adjacencySlot(graph->adjList, u); temp; temp = temp->next)
+        {
+            if (count == capacity)
+            {
+                capacity *= 2;
+                edges = (struct PackedEdge *)realloc(edges, capacity * sizeof(struct PackedEdge));
+                if (!edges)
+                {
+                    perror("Memory allocation failed");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            if (!packEdge(u, temp->data, temp->distance, temp->direction, &edges[count]))
+            {
+                printf("Edge %lld -> %lld has a distance that cannot be compressed. Keeping the uncompressed map.\n",
+                       vertexId(graph, u), vertexId(graph, temp->data));
+                free(edges);
+                free(compressed->offsets);
+                free(compressed->bytes);
+                free(compressed);
+                return;
+            }
+            count++;
+        }
+        qsort(edges, count, sizeof(struct PackedEdge), comparePackedEdge);
+        encodeVertexEdges(compressed, u, edges, count);
+    }
+    free(edges);
+    compressed->bytes = (unsigned char *)realloc(compressed->bytes, compressed->size + 1);
+    compressed->capacity = compressed->size + 1;
+
+    for (int u = 0; u < graph->V; u++)
+    {
+        struct Node *temp = *adjacencySlot(graph->adjList, u);
+        while (temp)
+        {
+            struct Node *next = temp->next;
+            free(temp);
+            listBytes += sizeof(struct Node);
+            temp = next;
+        }
+    }
+    freeAdjacency(graph->adjList, graph->V);
+    graph->adjList = NULL;
+    graph->compressed = compressed;
+
+    size_t compressedBytes = compressed->size + (graph->V + 1) * sizeof(unsigned int);
+    printf("Compressed %d edges: %zu bytes -> %zu bytes (%.2f bytes per edge)\n", compressed->E,
+           listBytes, compressedBytes, compressed->E ? (double)compressedBytes / compressed->E : 0.0);
+}
+
+
+// Shortest of the parallel src -> dest edges, used when printing directions.
+bool findShortestEdge(struct Graph *graph, int src, int dest, int *distance, enum Direction *direction)
+{
+    struct EdgeCursor cursor;
+    int target, edgeDistance;
+    enum Direction edgeDirection;
+    bool found = false;
+    firstEdge(graph, src, &cursor);
+    while (nextEdge(&cursor, &target, &edgeDistance, &edgeDirection))
+    {
+        if (target == dest && (!found || edgeDistance < *distance))
+        {
+            *distance = edgeDistance;
+            *direction = edgeDirection;
+            found = true;
+        }
+    }
+    return found;
+}
+
+
+double elapsedSeconds(struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+
+int availableThreads(void)
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+}
+
+
+struct MinHeap *createMinHeap(int capacity)
+{
+    struct MinHeap *heap = (struct MinHeap *)malloc(sizeof(struct MinHeap));
+    if (!heap)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    heap->size = 0;
+    heap->capacity = capacity > 0 ? capacity : 16;
+    heap->entries = (struct HeapEntry *)malloc(heap->capacity * sizeof(struct HeapEntry));
+    if (!heap->entries)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    return heap;
+}
+
+
+void freeMinHeap(struct MinHeap *heap)
+{
+    if (heap)
+    {
+        free(heap->entries);
+        free(heap);
+    }
+}
+
+
+bool heapBefore(struct HeapEntry *a, struct HeapEntry *b)
+{
+    return a->key < b->key || (a->key == b->key && a->order < b->order);
+}
+
+
+// Binary heap without decrease-key: improved vertices are pushed again and
+// stale entries are skipped when popped. Equal keys pop in increasing order.
+void heapPushOrdered(struct MinHeap *heap, int key, int order, int vertex)
+{
+    if (heap->size == heap->capacity)
+    {
+        heap->capacity *= 2;
+        heap->entries = (struct HeapEntry *)realloc(heap->entries, heap->capacity * sizeof(struct HeapEntry));
+        if (!heap->entries)
+        {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    struct HeapEntry entry = {key, order, vertex};
+    int i = heap->size++;
+    while (i > 0)
+    {
+        int parent = (i - 1) / 2;
+        if (!heapBefore(&entry, &heap->entries[parent]))
+        {
+            break;
+        }
+        heap->entries[i] = heap->entries[parent];
+        i = parent;
+    }
+    heap->entries[i] = entry;
+}
+
+
+void heapPush(struct MinHeap *heap, int key, int vertex)
+{
+    heapPushOrdered(heap, key, 0, vertex);
+}
+
+
+struct HeapEntry heapPop(struct MinHeap *heap)
+{
+    struct HeapEntry top = heap->entries[0];
+    struct HeapEntry last = heap->entries[--heap->size];
+    int i = 0;
+    while (true)
+    {
+        int child = 2 * i + 1;
+        if (child >= heap->size)
+        {
+            break;
+        }
+        if (child + 1 < heap->size && heapBefore(&heap->entries[child + 1], &heap->entries[child]))
+        {
+            child++;
+        }
+        if (!heapBefore(&heap->entries[child], &last))
+        {
+            break;
+        }
+        heap->entries[i] = heap->entries[child];
+        i = child;
+    }
+    if (heap->size > 0)
+    {
+        heap->entries[i] = last;
+    }
+    return top;
+}
+
+
+// Flat forward or reverse copy of the adjacency for the preprocessing
+// passes, which sweep the whole map many times.
+struct CSRGraph *buildCSR(struct Graph *graph, bool reverse)
+{
+    int V = graph->V;
+    struct CSRGraph *csr = (struct CSRGraph *)malloc(sizeof(struct CSRGraph));
+    if (!csr)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    csr->V = V;
+    csr->offsets = (int *)calloc(V + 1, sizeof(int));
+    if (!csr->offsets)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int u = 0; u < V; u++)
+    {
+        struct EdgeCursor cursor;
+        int v, distance;
+        enum Direction direction;
+        firstEdge(graph, u, &cursor);
+        while (nextEdge(&cursor, &v, &distance, &direction))
+        {
+            csr->offsets[(reverse ? v : u) + 1]++;
+        }
+    }
+    for (int u = 0; u < V; u++)
+    {
+        csr->offsets[u + 1] += csr->offsets[u];
+    }
+    csr->E = csr->offsets[V];
+
+    int *fill = (int *)malloc((V + 1) * sizeof(int));
+    csr->targets = (int *)malloc((csr->E + 1) * sizeof(int));
+    csr->weights = (int *)malloc((csr->E + 1) * sizeof(int));
+    csr->directions = (unsigned char *)malloc(csr->E + 1);
+    if (!fill || !csr->targets || !csr->weights || !csr->directions)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(fill, csr->offsets, (V + 1) * sizeof(int));
+    for (int u = 0; u < V; u++)
+    {
+        struct EdgeCursor cursor;
+        int v, distance;
+        enum Direction direction;
+        firstEdge(graph, u, &cursor);
+        while (nextEdge(&cursor, &v, &distance, &direction))
+        {
+            int k = fill[reverse ? v : u]++;
+            csr->targets[k] = reverse ? u : v;
+            csr->weights[k] = distance;
+            csr->directions[k] = (unsigned char)direction;
+        }
+    }
+    free(fill);
+    return csr;
+}
+
+
+void freeCSR(struct CSRGraph *csr)
+{
+    if (csr)
+    {
+        free(csr->offsets);
+        free(csr->targets);
+        free(csr->weights);
+        free(csr->directions);
+        free(csr);
+    }
+}
+
+
+// Forward and reverse CSR shared by the range, nearest-POI and route queries.
+// It is read-only once built; each query keeps its state in a workspace.
+struct RangeIndex *buildRangeIndex(struct Graph *graph)
+{
+    struct RangeIndex *range = (struct RangeIndex *)malloc(sizeof(struct RangeIndex));
+    if (!range)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    range->forward = buildCSR(graph, false);
+    range->reverse = buildCSR(graph, true);
+    return range;
+}
+
+
+void freeRangeIndex(struct RangeIndex *range)
+{
+    if (range)
+    {
+        freeCSR(range->forward);
+        freeCSR(range->reverse);
+        free(range);
+    }
+}
+
+
+// Connectivity index: strongly connected components numbered in topological
+// order of the condensation DAG, plus two DFS interval labellings of that DAG.
+// If a component reaches another, its intervals contain the other's, so most
+// "no route" answers need only a few comparisons.
+void labelIntervals(struct ConnectivityIndex *index, int labelling, int *stack, int *next)
+{
+    int C = index->components;
+    int *low = index->low[labelling];
+    int *post = index->post[labelling];
+    int counter = 0;
+
+    for (int c = 0; c < C; c++)
+    {
+        post[c] = -1;
+    }
+
+    for (int root = 0; root < C; root++)
+    {
+        if (post[root] != -1)
+        {
+            continue;
+        }
+        int top = 0;
+        stack[top] = root;
+        next[root] = 0;
+        post[root] = -2;
+        low[root] = C;
+
+        while (top >= 0)
+        {
+            int c = stack[top];
+            int degree = index->dagOffsets[c + 1] - index->dagOffsets[c];
+            if (next[c] < degree)
+            {
+                int k = next[c]++;
+                int child = index->dagTargets[labelling == 0 ? index->dagOffsets[c] + k
+                                                             : index->dagOffsets[c + 1] - 1 - k];
+                if (post[child] == -1)
+                {
+                    post[child] = -2;
+                    low[child] = C;
+                    next[child] = 0;
+                    stack[++top] = child;
+                }
+                else if (low[child] < low[c])
+                {
+                    low[c] = low[child];
+                }
+            }
+            else
+            {
+                post[c] = counter++;
+                if (post[c] < low[c])
+                {
+                    low[c] = post[c];
+                }
+                top--;
+                if (top >= 0 && low[c] < low[stack[top]])
+                {
+                    low[stack[top]] = low[c];
+                }
+            }
+        }
+    }
+}
+
+
+struct ConnectivityIndex *buildConnectivityIndex(struct Graph *graph)
+{
+    int V = graph->V;
+    struct ConnectivityIndex *index = (struct ConnectivityIndex *)malloc(sizeof(struct ConnectivityIndex));
+    int *order = (int *)malloc(V * sizeof(int));
+    int *lowlink = (int *)malloc(V * sizeof(int));
+    int *sccStack = (int *)malloc(V * sizeof(int));
+    bool *onStack = (bool *)calloc(V, sizeof(bool));
+    struct TarjanFrame *frames = (struct TarjanFrame *)malloc(V * sizeof(struct TarjanFrame));
+    if (!index || !order || !lowlink || !sccStack || !onStack || !frames)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    index->component = (int *)malloc(V * sizeof(int));
+    if (!index->component)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int v = 0; v < V; v++)
+    {
+        order[v] = -1;
+    }
+
+    // Iterative Tarjan, so long roads cannot overflow the call stack.
+    int counter = 0, sccTop = 0, components = 0;
+    for (int root = 0; root < V; root++)
+    {
+        if (order[root] != -1)
+        {
+            continue;
+        }
+        int top = 0;
+        frames[0].vertex = root;
+        firstEdge(graph, root, &frames[0].cursor);
+        order[root] = lowlink[root] = counter++;
+        sccStack[sccTop++] = root;
+        onStack[root] = true;
+
+        while (top >= 0)
+        {
+            int v = frames[top].vertex;
+            int w, distance;
+            enum Direction direction;
+            if (nextEdge(&frames[top].cursor, &w, &distance, &direction))
+            {
+                if (order[w] == -1)
+                {
+                    order[w] = lowlink[w] = counter++;
+                    sccStack[sccTop++] = w;
+                    onStack[w] = true;
+                    top++;
+                    frames[top].vertex = w;
+                    firstEdge(graph, w, &frames[top].cursor);
+                }
+                else if (onStack[w] && order[w] < lowlink[v])
+                {
+                    lowlink[v] = order[w];
+                }
+                continue;
+            }
+
+            if (lowlink[v] == order[v])
+            {
+                int x;
+                do
+                {
+                    x = sccStack[--sccTop];
+                    onStack[x] = false;
+                    index->component[x] = components;
+                } while (x != v);
+                components++;
+            }
+            top--;
+            if (top >= 0 && lowlink[v] < lowlink[frames[top].vertex])
+            {
+                lowlink[frames[top].vertex] = lowlink[v];
+            }
+        }
+    }
+
+    // Tarjan finishes sink components first; flip to a topological numbering.
+    for (int v = 0; v < V; v++)
+    {
+        index->component[v] = components - 1 - index->component[v];
+    }
+    index->components = components;
+
+    index->dagOffsets = (int *)calloc(components + 1, sizeof(int));
+    if (!index->dagOffsets)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    for (int u = 0; u < V; u++)
+    {
+        struct EdgeCursor cursor;
+        int w, distance;
+        enum Direction direction;
+        firstEdge(graph, u, &cursor);
+        while (nextEdge(&cursor, &w, &distance, &direction))
+        {
+            if (index->component[u] != index->component[w])
+            {
+                index->dagOffsets[index->component[u] + 1]++;
+            }
+        }
+    }
+    for (int c = 0; c < components; c++)
+    {
+        index->dagOffsets[c + 1] += index->dagOffsets[c];
+    }
+    int *fill = (int *)malloc((components + 1) * sizeof(int));
+    index->dagTargets = (int *)malloc((index->dagOffsets[components] + 1) * sizeof(int));
+    if (!fill || !index->dagTargets)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(fill, index->dagOffsets, (components + 1) * sizeof(int));
+    for (int u = 0; u < V; u++)
+    {
+        struct EdgeCursor cursor;
+        int w, distance;
+        enum Direction direction;
+        firstEdge(graph, u, &cursor);
+        while (nextEdge(&cursor, &w, &distance, &direction))
+        {
+            if (index->component[u] != index->component[w])
+            {
+                index->dagTargets[fill[index->component[u]]++] = index->component[w];
+            }
+        }
+    }
+
+    // Drop parallel DAG arcs; lowlink doubles as the "last source" marker.
+    int kept = 0;
+    for (int c = 0; c < components; c++)
+    {
+        lowlink[c] = -1;
+    }
+    for (int c = 0; c < components; c++)
+    {
+        int start = index->dagOffsets[c];
+        index->dagOffsets[c] = kept;
+        for (int k = start; k < fill[c]; k++)
+        {
+            int target = index->dagTargets[k];
+            if (lowlink[target] != c)
+            {
+                lowlink[target] = c;
+                index->dagTargets[kept++] = target;
+            }
+        }
+    }
+    index->dagOffsets[components] = kept;
+
+    for (int labelling = 0; labelling < 2; labelling++)
+    {
+        index->low[labelling] = (int *)malloc((components + 1) * sizeof(int));
+        index->post[labelling] = (int *)malloc((components + 1) * sizeof(int));
+        if (!index->low[labelling] || !index->post[labelling])
+        {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+        labelIntervals(index, labelling, sccStack, order);
+    }
+
+    free(order);
+    free(lowlink);
+    free(sccStack);
+    free(onStack);
+    free(frames);
+    free(fill);
+    return index;
+}
+
+
+void freeConnectivityIndex(struct ConnectivityIndex *index)
+{
+    if (!index)
+    {
+        return;
+    }
+    free(index->component);
+    free(index->dagOffsets);
+    free(index->dagTargets);
+    for (int labelling = 0; labelling < 2; labelling++)
+    {
+        free(index->low[labelling]);
+        free(index->post[labelling]);
+    }
+    free(index);
+}
+
+
+// O(1) filter on components: false means "definitely no route".
+bool componentMayReach(struct ConnectivityIndex *index, int from, int to)
+{
+    if (from == to)
+    {
+        return true;
+    }
+    if (from > to)
+    {
+        return false;
+    }
+    for (int labelling = 0; labelling < 2; labelling++)
+    {
+        if (index->low[labelling][to] < index->low[labelling][from] ||
+            index->post[labelling][to] > index->post[labelling][from])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// A commit that may have joined components leaves the index stale. The first
+// query after it rebuilds the index; queries running meanwhile see none and
+// simply skip the pruning.
+struct ConnectivityIndex *connectivityIndex(struct Graph *graph)
+{
+    if (atomic_exchange(&graph->connectivityStale, false))
+    {
+        atomic_store(&graph->connectivity, buildConnectivityIndex(graph));
+    }
+    return atomic_load(&graph->connectivity);
+}
+
+
+bool mayReach(struct Graph *graph, int src, int dest)
+{
+    struct ConnectivityIndex *index = connectivityIndex(graph);
+    return !index || componentMayReach(index, index->component[src], index->component[dest]);
+}
+
+
+// Exact reachability between internal vertices. Falls back to a walk over
+// the condensation DAG, pruned by the labels, only when they cannot decide.
+bool canReach(struct Graph *graph, int src, int dest)
+{
+    struct ConnectivityIndex *index = connectivityIndex(graph);
+    if (!index)
+    {
+        return true;
+    }
+    int from = index->component[src], to = index->component[dest];
+    if (from == to)
+    {
+        return true;
+    }
+    if (!componentMayReach(index, from, to))
+    {
+        return false;
+    }
+
+    bool *seen = (bool *)calloc(index->components, sizeof(bool));
+    int *stack = (int *)malloc(index->components * sizeof(int));
+    if (!seen || !stack)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    bool found = false;
+    int top = 0;
+    stack[top++] = from;
+    seen[from] = true;
+    while (top > 0 && !found)
+    {
+        int c = stack[--top];
+        for (int k = index->dagOffsets[c]; k < index->dagOffsets[c + 1]; k++)
+        {
+            int next = index->dagTargets[k];
+            if (next == to)
+            {
+                found = true;
+                break;
+            }
+            if (!seen[next] && componentMayReach(index, next, to))
+            {
+                seen[next] = true;
+                stack[top++] = next;
+            }
+        }
+    }
+    free(seen);
+    free(stack);
+    return found;
+}
+
+
+
+// Shortest-path tree over a CSR for the alternative route search. Like the
+// workspace it is reset by bumping a generation: reached and done hold the
+// generation in which a vertex was last reached and settled.
+struct RouteTree *createRouteTree(int V)
+{
+    struct RouteTree *tree = (struct RouteTree *)malloc(sizeof(struct RouteTree));
+    if (!tree)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    tree->distance = (int *)malloc(V * sizeof(int));
+    tree->parent = (int *)malloc(V * sizeof(int));
+    tree->parentEdge = (int *)malloc(V * sizeof(int));
+    tree->settled = (int *)malloc(V * sizeof(int));
+    tree->reached = (unsigned int *)calloc(V, sizeof(unsigned int));
+    tree->done = (unsigned int *)calloc(V, sizeof(unsigned int));
+    tree->settledCount = 0;
+    tree->generation = 0;
+    tree->V = V;
+    if (!tree->distance || !tree->parent || !tree->parentEdge || !tree->settled || !tree->reached || !tree->done)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    return tree;
+}
+
+
+void freeRouteTree(struct RouteTree *tree)
+{
+    if (tree)
+    {
+        free(tree->distance);
+        free(tree->parent);
+        free(tree->parentEdge);
+        free(tree->settled);
+        free(tree->reached);
+        free(tree->done);
+        free(tree);
+    }
+}
+
+
+// Scratch for one shortest-path search. The graph is only read while
+// searching, so any number of threads can query it with their own workspace.
+struct SearchWorkspace *createSearchWorkspace(int V)
+{
+    struct SearchWorkspace *workspace = (struct SearchWorkspace *)malloc(sizeof(struct SearchWorkspace));
+    if (!workspace)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    workspace->distance = (int *)malloc(V * sizeof(int));
+    workspace->parent = (int *)malloc(V * sizeof(int));
+    workspace->visited = (bool *)malloc(V * sizeof(bool));
+    workspace->path = (int *)malloc(V * sizeof(int));
+    workspace->stamp = (unsigned int *)calloc(V, sizeof(unsigned int));
+    workspace->generation = 0;
+    workspace->V = V;
+    workspace->heap = createMinHeap(64);
+    workspace->forwardTree = NULL;
+    workspace->backwardTree = NULL;
+    if (!workspace->distance || !workspace->parent || !workspace->visited || !workspace->path || !workspace->stamp)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    return workspace;
+}
+
+
+void freeSearchWorkspace(struct SearchWorkspace *workspace)
+{
+    free(workspace->distance);
+    free(workspace->parent);
+    free(workspace->visited);
+    free(workspace->path);
+    free(workspace->stamp);
+    freeMinHeap(workspace->heap);
+    freeRouteTree(workspace->forwardTree);
+    freeRouteTree(workspace->backwardTree);
+    free(workspace);
+}
+
+
+// Starts a new search in O(1). An entry stamped with an older generation
+// reads as unreached, so only the stamps have to be cleared, and only when
+// the counter wraps around.
+void beginSearch(struct SearchWorkspace *workspace)
+{
+    if (++workspace->generation == 0)
+    {
+        memset(workspace->stamp, 0, workspace->V * sizeof(unsigned int));
+        workspace->generation = 1;
+    }
+    workspace->heap->size = 0;
+}
+
+
+// Brings v into the current search; call before reading its entries.
+void touchVertex(struct SearchWorkspace *workspace, int v)
+{
+    if (workspace->stamp[v] != workspace->generation)
+    {
+        workspace->stamp[v] = workspace->generation;
+        workspace->distance[v] = 10000;
+        workspace->parent[v] = -1;
+        workspace->visited[v] = false;
+    }
+}
+
+
+// Distance of v in the current search, INT_MAX while the search has not
+// reached it. Used by the CSR searches, whose distances may exceed 10000.
+int reachedDistance(struct SearchWorkspace *workspace, int v)
+{
+    return workspace->stamp[v] == workspace->generation ? workspace->distance[v] : INT_MAX;
+}
+
+
+void reachVertex(struct SearchWorkspace *workspace, int v, int distance, int parent)
+{
+    workspace->stamp[v] = workspace->generation;
+    workspace->distance[v] = distance;
+    workspace->parent[v] = parent;
+}
+
+
+void DFS(struct Graph *graph, struct SearchWorkspace *workspace, int src, int dest, int totalDistance, int pathIndex)
+{
+    bool *visited = workspace->visited;
+    int *path = workspace->path;
+    visited[src] = true;
+    path[pathIndex] = src;
+    pathIndex++;
+
+    if (src == dest)
+    {
+        printf("Path: ");
+        for (int i = 0; i < pathIndex; i++)
+        {
+            printf("%lld", vertexId(graph, path[i]));
+            if (i < pathIndex - 1)
+            {
+                int edgeDistance;
+                enum Direction direction;
+                findEdge(graph, path[i], path[i + 1], &edgeDistance, &direction);
+                printf(" (%s) -> ", directionName(direction));
+            }
+        }
+        printf("\n");
+
+        printf("Total Distance: %d\n", totalDistance);
+    }
+    else
+    {
+        struct EdgeCursor cursor;
+        int neighbor, edgeDistance;
+        enum Direction direction;
+        firstEdge(graph, src, &cursor);
+        while (nextEdge(&cursor, &neighbor, &edgeDistance, &direction))
+        {
+            touchVertex(workspace, neighbor);
+            if (!visited[neighbor] && mayReach(graph, neighbor, dest))
+            {
+                totalDistance += edgeDistance;
+                DFS(graph, workspace, neighbor, dest, totalDistance, pathIndex);
+                totalDistance -= edgeDistance;
+            }
+        }
+    }
+
+    visited[src] = false; 
+}
+
+
+
+void findPaths(struct Graph *graph, struct SearchWorkspace *workspace, int src, int dest)
+{
+    if (src < 0 || src >= graph->V || dest < 0 || dest >= graph->V)
+    {
+        printf("Invalid source or destination node.\n");
+        return;
+    }
+
+    if (!canReach(graph, toInternal(graph, src), toInternal(graph, dest)))
+    {
+        printf("No route from node %lld to node %lld.\n", mapId(graph, src), mapId(graph, dest));
+        return;
+    }
+
+    beginSearch(workspace);
+    touchVertex(workspace, toInternal(graph, src));
+    printf("Paths from node %lld to node %lld:\n", mapId(graph, src), mapId(graph, dest));
+    DFS(graph, workspace, toInternal(graph, src), toInternal(graph, dest), 0, 0);
+}
+
+
+int findPoiTag(struct PoiIndex *pois, const char *tag)
+{
+    for (int t = 0; t < pois->tagCount; t++)
+    {
+        if (strcmp(pois->tagNames[t], tag) == 0)
+        {
+            return t;
+        }
+    }
+    return -1;
+}
+
+
+// Chains the points of interest by internal vertex; called again after the
+// vertices are renumbered.
+void linkPointsOfInterest(struct Graph *graph)
+{
+    struct PoiIndex *pois = graph->pois;
+    for (int v = 0; v < graph->V; v++)
+    {
+        pois->first[v] = -1;
+    }
+    for (int p = pois->count - 1; p >= 0; p--)
+    {
+        int v = toInternal(graph, pois->vertex[p]);
+        pois->next[p] = pois->first[v];
+        pois->first[v] = p;
+    }
+}
+
+
+void freeNearestPoiIndex(struct PoiIndex *pois)
+{
+    if (pois)
+    {
+        free(pois->nearest);
+        free(pois->nearestDistance);
+        pois->nearest = NULL;
+        pois->nearestDistance = NULL;
+        pois->nearestK = 0;
+    }
+}
+
+
+void freePointsOfInterest(struct PoiIndex *pois)
+{
+    if (pois)
+    {
+        freeNearestPoiIndex(pois);
+        free(pois->vertex);
+        free(pois->tag);
+        free(pois->next);
+        free(pois->first);
+        free(pois->tagNames);
+        free(pois);
+    }
+}
+
+
+// Reads the optional "poi <vertex> <tag>" lines that follow the edges.
+void addPointOfInterest(struct Graph *graph, int vertex, const char *tag)
+{
+    if (!graph->pois)
+    {
+        graph->pois = (struct PoiIndex *)calloc(1, sizeof(struct PoiIndex));
+        if (!graph->pois)
+        {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    struct PoiIndex *pois = graph->pois;
+    int t = findPoiTag(pois, tag);
+    if (t == -1)
+    {
+        if (pois->tagCount == pois->tagCapacity)
+        {
+            pois->tagCapacity = pois->tagCapacity ? pois->tagCapacity * 2 : 8;
+            pois->tagNames = (char (*)[32])realloc(pois->tagNames, pois->tagCapacity * sizeof(*pois->tagNames));
+            if (!pois->tagNames)
+            {
+                perror("Memory allocation failed");
+                exit(EXIT_FAILURE);
+            }
+        }
+        t = pois->tagCount++;
+        strcpy(pois->tagNames[t], tag);
+    }
+    if (pois->count == pois->capacity)
+    {
+        pois->capacity = pois->capacity ? pois->capacity * 2 : 64;
+        pois->vertex = (int *)realloc(pois->vertex, pois->capacity * sizeof(int));
+        pois->tag = (int *)realloc(pois->tag, pois->capacity * sizeof(int));
+        if (!pois->vertex || !pois->tag)
+        {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    pois->vertex[pois->count] = vertex;
+    pois->tag[pois->count] = t;
+    pois->count++;
+}
+
+
+// Builds the per-vertex chains once every point of interest has been added.
+void indexPointsOfInterest(struct Graph *graph)
+{
+    if (graph->pois)
+    {
+        graph->pois->next = (int *)malloc(graph->pois->count * sizeof(int));
+        graph->pois->first = (int *)malloc(graph->V * sizeof(int));
+        if (!graph->pois->next || !graph->pois->first)
+        {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+        linkPointsOfInterest(graph);
+    }
+}
+
+
+void readPointsOfInterest(FILE *file, struct Graph *graph)
+{
+    long long id;
+    char tag[32];
+    while (fscanf(file, " poi %lld %31s", &id, tag) == 2)
+    {
+        int vertex = denseId(graph, id);
+        if (vertex == -1)
+        {
+            printf("Point of interest %lld is not a vertex of the map, skipped.\n", id);
+            continue;
+        }
+        addPointOfInterest(graph, vertex, tag);
+    }
+    indexPointsOfInterest(graph);
+}
+
+
+// Points of interest are data rather than a derived index, so a new snapshot
+// carries its own copy of them.
+struct PoiIndex *copyPointsOfInterest(struct PoiIndex *pois, struct Graph *graph)
+{
+    struct PoiIndex *copy = (struct PoiIndex *)calloc(1, sizeof(struct PoiIndex));
+    if (!copy)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    copy->count = pois->count;
+    copy->capacity = pois->count;
+    copy->tagCount = pois->tagCount;
+    copy->tagCapacity = pois->tagCount;
+    copy->vertex = (int *)malloc((pois->count + 1) * sizeof(int));
+    copy->tag = (int *)malloc((pois->count + 1) * sizeof(int));
+    copy->next = (int *)malloc((pois->count + 1) * sizeof(int));
+    copy->first = (int *)malloc(graph->V * sizeof(int));
+    copy->tagNames = (char (*)[32])malloc((pois->tagCount + 1) * sizeof(*pois->tagNames));
+    if (!copy->vertex || !copy->tag || !copy->next || !copy->first || !copy->tagNames)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(copy->vertex, pois->vertex, pois->count * sizeof(int));
+    memcpy(copy->tag, pois->tag, pois->count * sizeof(int));
+    memcpy(copy->tagNames, pois->tagNames, pois->tagCount * sizeof(*pois->tagNames));
+    graph->pois = copy;
+    linkPointsOfInterest(graph);
+    return copy;
+}
+
+
+// The first line holds the vertex count, or "sparse" for a map whose vertex
+// IDs are arbitrary 64-bit values; those are interned as the edges are read.
+bool readMapHeader(FILE *file, int *V, struct IdTable **ids)
+{
+    char header[16];
+    *ids = NULL;
+    if (fscanf(file, "%15s", header) != 1)
+    {
+        return false;
+    }
+    if (strcmp(header, "sparse") == 0)
+    {
+        *V = 0;
+        *ids = createIdTable();
+        return true;
+    }
+    char *end;
+    long count = strtol(header, &end, 10);
+    *V = (int)count;
+    return *end == '\0' && count >= 0 && count <= INT_MAX;
+}
+
+
+int readVertexId(struct IdTable *ids, long long id, int V)
+{
+    if (ids)
+    {
+        return internId(ids, id);
+    }
+    return id >= 0 && id < V ? (int)id : -1;
+}
+
+
+struct Graph *loadMapFromFile(const char *filename)
+{
+    FILE *file = fopen(filename, "r");
+    if (!file)
+    {
+        perror("Failed to open the file for reading");
+        return NULL;
+    }
+
+    int V;
+    struct IdTable *ids;
+    if (!readMapHeader(file, &V, &ids))
+    {
+        perror("Invalid file format");
+        fclose(file);
+        return NULL;
+    }
+
+    struct Graph *graph = createGraph(V);
+    graph->ids = ids;
+    long long srcId, destId;
+    int distance;
+    char directionStr[10];
+    while (fscanf(file, "%lld %lld %d %9s", &srcId, &destId, &distance, directionStr) == 4)
+    {
+        enum Direction direction;
+        if (!parseDirection(directionStr, &direction)) {
+            printf("Invalid input for the direction. Please enter 'right', 'left', 'straight', or 'back'.\n");
+            continue;
+        }
+
+        int src = readVertexId(ids, srcId, V);
+        int dest = readVertexId(ids, destId, V);
+        if (ids)
+        {
+            if (adjacencyBlocks(ids->count) > adjacencyBlocks(graph->V))
+            {
+                graph->adjList = growAdjacency(graph->adjList, graph->V, ids->count);
+            }
+            graph->V = ids->count;
+        }
+
+        if (src != -1 && dest != -1)
+        {
+            struct Node *newNode = createNode(dest, distance, direction);
+            newNode->next = *adjacencySlot(graph->adjList, src);
+            *adjacencySlot(graph->adjList, src) = newNode;
+
+        }
+    }
+    readPointsOfInterest(file, graph);
+
+    fclose(file);
+    return graph;
+}
+
+
+// Loads straight into the compressed adjacency so the linked lists never have
+// to fit in memory: edges are staged as 12-byte records, sorted and encoded.
+struct Graph *loadCompressedMapFromFile(const char *filename)
+{
+    FILE *file = fopen(filename, "r");
+    if (!file)
+    {
+        perror("Failed to open the file for reading");
+        return NULL;
+    }
+
+    int V;
+    struct IdTable *ids;
+    if (!readMapHeader(file, &V, &ids))
+    {
+        perror("Invalid file format");
+        fclose(file);
+        return NULL;
+    }
+
+    int count = 0, capacity = 1024;
+    struct PackedEdge *edges = (struct PackedEdge *)malloc(capacity * sizeof(struct PackedEdge));
+    if (!edges)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+
+    long long srcId, destId;
+    int distance;
+    char directionStr[10];
+    while (fscanf(file, "%lld %lld %d %9s", &srcId, &destId, &distance, directionStr) == 4)
+    {
+        enum Direction direction;
+        if (!parseDirection(directionStr, &direction)) {
+            printf("Invalid input for the direction. Please enter 'right', 'left', 'straight', or 'back'.\n");
+            continue;
+        }
+
+        int src = readVertexId(ids, srcId, V);
+        int dest = readVertexId(ids, destId, V);
+        if (src != -1 && dest != -1)
+        {
+            if (count == capacity)
+            {
+                capacity *= 2;
+                edges = (struct PackedEdge *)realloc(edges, capacity * sizeof(struct PackedEdge));
+                if (!edges)
+                {
+                    perror("Memory allocation failed");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            if (!packEdge(src, dest, distance, direction, &edges[count]))
+            {
+                printf("Edge %lld -> %lld has a distance that cannot be compressed.\n", srcId, destId);
+                free(edges);
+                freeIdTable(ids);
+                fclose(file);
+                return NULL;
+            }
+            count++;
+        }
+    }
+    if (ids)
+    {
+        V = ids->count;
+    }
+    struct Graph *graph = createGraph(V);
+    graph->ids = ids;
+    readPointsOfInterest(file, graph);
+    fclose(file);
+
+    qsort(edges, count, sizeof(struct PackedEdge), comparePackedEdge);
+
+    freeAdjacency(graph->adjList, V);
+    graph->adjList = NULL;
+    graph->compressed = createCompressedAdjacency(V);
+
+    int k = 0;
+    for (int u = 0; u < V; u++)
+    {
+        int first = k;
+        while (k < count && edges[k].src == u)
+        {
+            k++;
+        }
+        encodeVertexEdges(graph->compressed, u, edges + first, k - first);
+    }
+    free(edges);
+    graph->compressed->bytes = (unsigned char *)realloc(graph->compressed->bytes, graph->compressed->size + 1);
+    graph->compressed->capacity = graph->compressed->size + 1;
+    return graph;
+}
+
+bool hasMagic(const char *filename, const char *magic)
+{
+    char bytes[8];
+    FILE *file = fopen(filename, "rb");
+    if (!file)
+    {
+        return false;
+    }
+    bool matches = fread(bytes, 1, 8, file) == 8 && memcmp(bytes, magic, 8) == 0;
+    fclose(file);
+    return matches;
+}
+
+
+// Reads only the header, the vertex numbering and the tile directory of a
+// file written by MAP_MAKE tile; edges are paged in as searches reach them.
+struct Graph *loadTiledMap(const char *filename, size_t cacheBytes)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        perror("Failed to open the file for reading");
+        return NULL;
+    }
+    struct stat info;
+    struct TileHeader header;
+    if (fstat(fd, &info) != 0 || !readAt(fd, &header, sizeof(header), 0) || memcmp(header.magic, "MAPTILE1", 8) != 0 ||
+        header.tileVertices == 0 || header.V > INT_MAX || header.tileCount != (header.V + header.tileVertices - 1) /
+        header.tileVertices || header.directoryPos + (uint64_t)header.tileCount * sizeof(struct TileEntry) >
+        (uint64_t)info.st_size)
+    {
+        printf("Invalid tiled map file.\n");
+        close(fd);
+        return NULL;
+    }
+
+    int V = (int)header.V;
+    struct TiledMap *tiles = (struct TiledMap *)malloc(sizeof(struct TiledMap));
+    struct Graph *graph = createGraph(V);
+    freeAdjacency(graph->adjList, V);
+    graph->adjList = NULL;
+    graph->order = (int *)malloc((V + 1) * sizeof(int));
+    graph->rank = (int *)malloc((V + 1) * sizeof(int));
+    if (!tiles || !graph->order || !graph->rank)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    tiles->fd = fd;
+    tiles->V = V;
+    tiles->E = (long long)header.E;
+    tiles->tileVertices = (int)header.tileVertices;
+    tiles->tileCount = (int)header.tileCount;
+    tiles->directory = (struct TileEntry *)malloc((tiles->tileCount + 1) * sizeof(struct TileEntry));
+    tiles->tile = (struct Tile *)calloc(tiles->tileCount + 1, sizeof(struct Tile));
+    if (!tiles->directory || !tiles->tile)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    tiles->head = -1;
+    tiles->tail = -1;
+    tiles->resident = 0;
+    tiles->cacheBytes = cacheBytes;
+    tiles->loads = 0;
+    tiles->evictions = 0;
+    pthread_mutex_init(&tiles->lock, NULL);
+    graph->tiles = tiles;
+
+    bool valid = readAt(fd, graph->order, V * sizeof(int32_t), header.externalPos) &&
+                 readAt(fd, tiles->directory, tiles->tileCount * sizeof(struct TileEntry), header.directoryPos);
+    for (int v = 0; valid && v < V; v++)
+    {
+        graph->rank[v] = -1;
+    }
+    for (int v = 0; valid && v < V; v++)
+    {
+        int external = graph->order[v];
+        valid = external >= 0 && external < V && graph->rank[external] == -1;
+        if (valid)
+        {
+            graph->rank[external] = v;
+        }
+    }
+    // Only the directory is checked here; each tile's contents are checked
+    // when it is paged in, so opening the map reads none of them.
+    for (int t = 0; valid && t < tiles->tileCount; t++)
+    {
+        valid = tiles->directory[t].position <= (uint64_t)info.st_size &&
+                tiles->directory[t].size <= (uint64_t)info.st_size - tiles->directory[t].position &&
+                validTileSize(tiles, t);
+    }
+    if (!valid)
+    {
+        printf("Invalid tiled map file.\n");
+        freeTiledMap(tiles);
+        free(graph->order);
+        free(graph->rank);
+        free(graph);
+        return NULL;
+    }
+
+    for (uint32_t k = 0; k < header.poiCount; k++)
+    {
+        struct TilePoi poi;
+        if (!readAt(fd, &poi, sizeof(poi), header.poiPos + k * sizeof(poi)))
+        {
+            break;
+        }
+        poi.tag[31] = '\0';
+        if (poi.vertex >= 0 && poi.vertex < V)
+        {
+            addPointOfInterest(graph, poi.vertex, poi.tag);
+        }
+    }
+    indexPointsOfInterest(graph);
+    return graph;
+}
+
+
+
+// FNV-1a, enough to catch truncated or damaged blocks.
+uint32_t blockChecksum(const unsigned char *bytes, size_t size)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t k = 0; k < size; k++)
+    {
+        hash = (hash ^ bytes[k]) * 16777619u;
+    }
+    return hash;
+}
+
+
+// Decodes one block of a packed map into its slice of the edge array and,
+// for list graphs, links the block's vertices. Returns false if the block is
+// damaged; the checksum is checked before anything is decoded.
+bool decodePackBlock(struct PackTask *task, int b)
+{
+    const struct PackBlock *block = &task->directory[b];
+    const unsigned char *pos = task->data + block->position;
+    const unsigned char *end = pos + block->size;
+    if (blockChecksum(pos, block->size) != block->checksum || block->size < (block->edges + 3) / 4)
+    {
+        return false;
+    }
+    const unsigned char *directions = pos;
+    pos += (block->edges + 3) / 4;
+
+    int V = (int)task->header->V;
+    int first = b * (int)task->header->blockVertices;
+    int last = first + (int)task->header->blockVertices < V ? first + (int)task->header->blockVertices : V;
+    struct PackedEdge *edges = task->edges + task->edgeStart[b];
+    unsigned int e = 0;
+    for (int u = first; u < last; u++)
+    {
+        if (pos >= end)
+        {
+            return false;
+        }
+        unsigned int degree = readVarint(&pos);
+        if (degree > block->edges - e)
+        {
+            return false;
+        }
+        int target = u;
+        for (unsigned int k = 0; k < degree; k++, e++)
+        {
+            if (pos >= end)
+            {
+                return false;
+            }
+            unsigned int delta = readVarint(&pos);
+            target += k == 0 ? (int)(delta >> 1) ^ -(int)(delta & 1) : (int)delta;
+            if (pos >= end || target < 0 || target >= V)
+            {
+                return false;
+            }
+            unsigned int distance = readVarint(&pos);
+            edges[e].src = u;
+            edges[e].dest = target;
+            edges[e].weight = (distance << 2) | ((directions[e / 4] >> (2 * (e % 4))) & 3);
+        }
+    }
+    if (e != block->edges || pos != end)
+    {
+        return false;
+    }
+
+    // Linked in reverse so each list comes out sorted by target.
+    for (int k = (int)block->edges - 1; task->lists && k >= 0; k--)
+    {
+        struct Node *node = createNode(edges[k].dest, (int)(edges[k].weight >> 2),
+                                       (enum Direction)(edges[k].weight & 3));
+        node->next = *adjacencySlot(task->graph->adjList, edges[k].src);
+        *adjacencySlot(task->graph->adjList, edges[k].src) = node;
+    }
+    return true;
+}
+
+
+void *packWorker(void *arg)
+{
+    struct PackTask *task = (struct PackTask *)arg;
+    int b;
+    while ((b = atomic_fetch_add(task->nextBlock, 1)) < (int)task->header->blockCount)
+    {
+        if (atomic_load(task->corrupt) == -1 && !decodePackBlock(task, b))
+        {
+            atomic_store(task->corrupt, b);
+        }
+    }
+    return NULL;
+}
+
+
+// Loads a map written by MAP_MAKE pack. The whole file is read at once and
+// its blocks are decoded in parallel, straight into the linked lists or into
+// the compressed adjacency.
+struct Graph *loadPackedMap(const char *filename, bool compressed)
+{
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    FILE *file = fopen(filename, "rb");
+    if (!file)
+    {
+        perror("Failed to open the file for reading");
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long fileSize = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    // Padding past the end keeps a varint running off a damaged block inside
+    // the buffer.
+    unsigned char *data = (unsigned char *)calloc(fileSize + 8, 1);
+    if (!data)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    bool valid = fileSize >= (long)sizeof(struct PackHeader) && fread(data, 1, fileSize, file) == (size_t)fileSize;
+    fclose(file);
+
+    struct PackHeader header;
+    memcpy(&header, data, sizeof(header));
+    valid = valid && header.blockVertices > 0 && header.V <= INT_MAX && header.E <= INT_MAX &&
+            header.blockCount == (header.V + header.blockVertices - 1) / header.blockVertices &&
+            header.directoryPos + (uint64_t)header.blockCount * sizeof(struct PackBlock) <= (uint64_t)fileSize &&
+            header.poiPos + (uint64_t)header.poiCount * sizeof(struct TilePoi) <= (uint64_t)fileSize;
+    int blockCount = valid ? (int)header.blockCount : 0;
+    struct PackBlock *directory = (struct PackBlock *)malloc((blockCount + 1) * sizeof(struct PackBlock));
+    long long *edgeStart = (long long *)malloc((blockCount + 1) * sizeof(long long));
+    if (!directory || !edgeStart)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    if (valid)
+    {
+        memcpy(directory, data + header.directoryPos, blockCount * sizeof(struct PackBlock));
+    }
+    edgeStart[0] = 0;
+    for (int b = 0; valid && b < blockCount; b++)
+    {
+        valid = directory[b].position + directory[b].size <= (uint64_t)fileSize;
+        edgeStart[b + 1] = edgeStart[b] + directory[b].edges;
+    }
+    valid = valid && (uint64_t)edgeStart[blockCount] == header.E;
+    if (!valid)
+    {
+        printf("Invalid packed map file.\n");
+        free(data);
+        free(directory);
+        free(edgeStart);
+        return NULL;
+    }
+
+    int V = (int)header.V;
+    struct Graph *graph = createGraph(V);
+    struct PackedEdge *edges = (struct PackedEdge *)malloc((header.E + 1) * sizeof(struct PackedEdge));
+    int threads = availableThreads();
+    pthread_t *ids = (pthread_t *)malloc(threads * sizeof(pthread_t));
+    struct PackTask *tasks = (struct PackTask *)malloc(threads * sizeof(struct PackTask));
+    if (!edges || !ids || !tasks)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    atomic_int nextBlock, corrupt;
+    atomic_init(&nextBlock, 0);
+    atomic_init(&corrupt, -1);
+    for (int t = 0; t < threads; t++)
+    {
+        tasks[t].data = data;
+        tasks[t].header = &header;
+        tasks[t].directory = directory;
+        tasks[t].edgeStart = edgeStart;
+        tasks[t].edges = edges;
+        tasks[t].graph = graph;
+        tasks[t].lists = !compressed;
+        tasks[t].nextBlock = &nextBlock;
+        tasks[t].corrupt = &corrupt;
+        pthread_create(&ids[t], NULL, packWorker, &tasks[t]);
+    }
+    for (int t = 0; t < threads; t++)
+    {
+        pthread_join(ids[t], NULL);
+    }
+    free(ids);
+    free(tasks);
+
+    int damaged = atomic_load(&corrupt);
+    if (damaged == -1 && compressed)
+    {
+        freeAdjacency(graph->adjList, V);
+        graph->adjList = NULL;
+        graph->compressed = createCompressedAdjacency(V);
+        long long k = 0;
+        for (int u = 0; u < V; u++)
+        {
+            long long first = k;
+            while (k < (long long)header.E && edges[k].src == u)
+            {
+                k++;
+            }
+            encodeVertexEdges(graph->compressed, u, edges + first, (int)(k - first));
+        }
+        graph->compressed->bytes = (unsigned char *)realloc(graph->compressed->bytes, graph->compressed->size + 1);
+        graph->compressed->capacity = graph->compressed->size + 1;
+    }
+    for (uint32_t k = 0; damaged == -1 && k < header.poiCount; k++)
+    {
+        struct TilePoi poi;
+        memcpy(&poi, data + header.poiPos + k * sizeof(poi), sizeof(poi));
+        poi.tag[31] = '\0';
+        if (poi.vertex >= 0 && poi.vertex < V)
+        {
+            addPointOfInterest(graph, poi.vertex, poi.tag);
+        }
+    }
+    free(edges);
+    free(data);
+    free(directory);
+    free(edgeStart);
+
+    if (damaged != -1)
+    {
+        printf("Block %d of the packed map is damaged (checksum or encoding mismatch).\n", damaged);
+        for (int u = 0; graph->adjList && u < V; u++)
+        {
+            while (*adjacencySlot(graph->adjList, u))
+            {
+                struct Node *next = (*adjacencySlot(graph->adjList, u))->next;
+                free(*adjacencySlot(graph->adjList, u));
+                *adjacencySlot(graph->adjList, u) = next;
+            }
+        }
+        freeAdjacency(graph->adjList, V);
+        free(graph);
+        return NULL;
+    }
+    indexPointsOfInterest(graph);
+    printf("Decoded %d blocks (%llu edges) in %.3f s using %d threads.\n", blockCount,
+           (unsigned long long)header.E, elapsedSeconds(&start), threads);
+    return graph;
+}
+
+
+// Settles vertices in order of distance and then external ID, so parents come
+// out exactly as with the original linear scan. Distances of 10000 or more
+// count as unreachable. Stops once target is settled unless target is -1.
+void shortestPathTree(struct Graph *graph, struct SearchWorkspace *workspace, int source, int target)
+{
+    int *distance = workspace->distance;
+    beginSearch(workspace);
+    touchVertex(workspace, source);
+    distance[source] = 0;
+    heapPushOrdered(workspace->heap, 0, toExternal(graph, source), source);
+    while (workspace->heap->size > 0)
+    {
+        int u = heapPop(workspace->heap).vertex;
+        if (workspace->visited[u])
+        {
+            continue;
+        }
+        workspace->visited[u] = true;
+        if (u == target)
+        {
+            break;
+        }
+
+        struct EdgeCursor cursor;
+        int v, weight;
+        enum Direction direction;
+        firstEdge(graph, u, &cursor);
+        while (nextEdge(&cursor, &v, &weight, &direction))
+        {
+            touchVertex(workspace, v);
+            if (!workspace->visited[v] && distance[u] + weight < distance[v])
+            {
+                distance[v] = distance[u] + weight;
+                workspace->parent[v] = u;
+                heapPushOrdered(workspace->heap, distance[v], toExternal(graph, v), v);
+            }
+        }
+    }
+}
+
+
+void printShortestPath(FILE *out, struct Graph *graph, struct SearchWorkspace *workspace, int dest)
+{
+    int length = 0;
+    for (int v = dest; v != -1; v = workspace->parent[v])
+    {
+        touchVertex(workspace, v);
+        workspace->path[length++] = v;
+    }
+    while (length > 0)
+    {
+        fprintf(out, "%lld ", vertexId(graph, workspace->path[--length]));
+    }
+}
+
+
+void dijkstra(struct Graph *graph, struct SearchWorkspace *workspace, int src)
+{
+    shortestPathTree(graph, workspace, toInternal(graph, src), -1);
+
+    printf("Shortest paths from node %lld:\n", mapId(graph, src));
+    for (int i = 0; i < graph->V; i++)
+    {
+        if (i != src)
+        {
+            int v = toInternal(graph, i);
+            touchVertex(workspace, v);
+            printf("Path from %lld to %lld: ", mapId(graph, src), mapId(graph, i));
+            printShortestPath(stdout, graph, workspace, v);
+            printf(" (Distance: %d)\n", workspace->distance[v]);
+        }
+    }
+}
+
+
+// Runs a file of "source destination" queries on a pool of threads sharing
+// the read-only graph. Each worker owns a search workspace and formats its
+// answer into its own buffer; the calling thread writes the answers in input
+// order and workers stay at most a window of queries ahead of the writer.
+void *batchWorker(void *arg)
+{
+    struct BatchWorker *worker = (struct BatchWorker *)arg;
+    struct QueryBatch *batch = worker->batch;
+    struct Graph *graph = batch->graph;
+    while (true)
+    {
+        pthread_mutex_lock(&batch->lock);
+        while (batch->next < batch->count && batch->next >= batch->written + BATCH_WINDOW)
+        {
+            pthread_cond_wait(&batch->space, &batch->lock);
+        }
+        if (batch->next == batch->count)
+        {
+            pthread_mutex_unlock(&batch->lock);
+            break;
+        }
+        int q = batch->next++;
+        pthread_mutex_unlock(&batch->lock);
+
+        long long srcId = batch->queries[2 * q], destId = batch->queries[2 * q + 1];
+        int src = denseId(graph, srcId), dest = denseId(graph, destId);
+        char *text = NULL;
+        size_t length = 0;
+        FILE *out = open_memstream(&text, &length);
+        if (!out)
+        {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+        if (src == -1 || dest == -1)
+        {
+            fprintf(out, "Invalid query %lld -> %lld.\n", srcId, destId);
+        }
+        else if (!mayReach(graph, toInternal(graph, src), toInternal(graph, dest)))
+        {
+            fprintf(out, "No route from node %lld to node %lld.\n", srcId, destId);
+        }
+        else
+        {
+            int target = toInternal(graph, dest);
+            shortestPathTree(graph, worker->workspace, toInternal(graph, src), target);
+            touchVertex(worker->workspace, target);
+            if (worker->workspace->visited[target])
+            {
+                fprintf(out, "Path from %lld to %lld: ", srcId, destId);
+                printShortestPath(out, graph, worker->workspace, target);
+                fprintf(out, " (Distance: %d)\n", worker->workspace->distance[target]);
+            }
+            else
+            {
+                fprintf(out, "No route from node %lld to node %lld.\n", srcId, destId);
+            }
+        }
+        fclose(out);
+
+        pthread_mutex_lock(&batch->lock);
+        batch->results[q % BATCH_WINDOW] = text;
+        pthread_cond_broadcast(&batch->ready);
+        pthread_mutex_unlock(&batch->lock);
+    }
+    return NULL;
+}
+
+
+void runQueryBatch(struct Graph *graph, const char *queryFile, const char *resultFile)
+{
+    FILE *file = fopen(queryFile, "r");
+    if (!file)
+    {
+        perror("Failed to open the file for reading");
+        return;
+    }
+    struct QueryBatch batch;
+    batch.graph = graph;
+    batch.count = 0;
+    int capacity = 1024;
+    batch.queries = (long long *)malloc(2 * capacity * sizeof(long long));
+    if (!batch.queries)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    long long src, dest;
+    while (fscanf(file, "%lld %lld", &src, &dest) == 2)
+    {
+        if (batch.count == capacity)
+        {
+            capacity *= 2;
+            batch.queries = (long long *)realloc(batch.queries, 2 * capacity * sizeof(long long));
+            if (!batch.queries)
+            {
+                perror("Memory allocation failed");
+                exit(EXIT_FAILURE);
+            }
+        }
+        batch.queries[2 * batch.count] = src;
+        batch.queries[2 * batch.count + 1] = dest;
+        batch.count++;
+    }
+    fclose(file);
+
+    FILE *out = fopen(resultFile, "w");
+    if (!out)
+    {
+        perror("Failed to open the file for writing");
+        free(batch.queries);
+        return;
+    }
+
+    batch.next = 0;
+    batch.written = 0;
+    batch.results = (char **)calloc(BATCH_WINDOW, sizeof(char *));
+    if (!batch.results)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    pthread_mutex_init(&batch.lock, NULL);
+    pthread_cond_init(&batch.ready, NULL);
+    pthread_cond_init(&batch.space, NULL);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int threads = availableThreads();
+    struct BatchWorker *workers = (struct BatchWorker *)malloc(threads * sizeof(struct BatchWorker));
+    pthread_t *ids = (pthread_t *)malloc(threads * sizeof(pthread_t));
+    if (!workers || !ids)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    for (int t = 0; t < threads; t++)
+    {
+        workers[t].batch = &batch;
+        workers[t].workspace = createSearchWorkspace(graph->V);
+        pthread_create(&ids[t], NULL, batchWorker, &workers[t]);
+    }
+
+    pthread_mutex_lock(&batch.lock);
+    while (batch.written < batch.count)
+    {
+        char *text = batch.results[batch.written % BATCH_WINDOW];
+        if (!text)
+        {
+            pthread_cond_wait(&batch.ready, &batch.lock);
+            continue;
+        }
+        batch.results[batch.written % BATCH_WINDOW] = NULL;
+        batch.written++;
+        pthread_cond_broadcast(&batch.space);
+        pthread_mutex_unlock(&batch.lock);
+        fputs(text, out);
+        free(text);
+        pthread_mutex_lock(&batch.lock);
+    }
+    pthread_mutex_unlock(&batch.lock);
+
+    for (int t = 0; t < threads; t++)
+    {
+        pthread_join(ids[t], NULL);
+        freeSearchWorkspace(workers[t].workspace);
+    }
+    fclose(out);
+    double seconds = elapsedSeconds(&start);
+    printf("Answered %d queries with %d threads in %.3f s (%.0f queries/s).\n", batch.count, threads, seconds,
+           seconds > 0 ? batch.count / seconds : 0.0);
+
+    pthread_mutex_destroy(&batch.lock);
+    pthread_cond_destroy(&batch.ready);
+    pthread_cond_destroy(&batch.space);
+    free(batch.results);
+    free(batch.queries);
+    free(workers);
+    free(ids);
+}
+
+
+// Follows the first tight predecessor from path[from] back to the source and
+// returns the number of vertices on the path.
+int extendTightPath(struct ShortestPathDag *dag, int path[], int choice[], int from, int source)
+{
+    int i = from;
+    while (path[i] != source)
+    {
+        choice[i] = dag->head[path[i]];
+        path[i + 1] = dag->edges[choice[i]].from;
+        i++;
+    }
+    return i + 1;
+}
+
+
+// Moves to the next tied path by switching the predecessor closest to the
+// source that still has an alternative; O(path length) per path.
+int nextTightPath(struct ShortestPathDag *dag, int path[], int choice[], int length, int source)
+{
+    for (int i = length - 2; i >= 0; i--)
+    {
+        if (dag->edges[choice[i]].next != -1)
+        {
+            choice[i] = dag->edges[choice[i]].next;
+            path[i + 1] = dag->edges[choice[i]].from;
+            return extendTightPath(dag, path, choice, i + 1, source);
+        }
+    }
+    return 0;
+}
+
+
+// Dijkstra that keeps every tight predecessor of a vertex, and the number of
+// shortest paths reaching it, instead of a single parent. Predecessors are
+// only recorded from vertices settled earlier, so the result is a DAG even
+// with zero-length edges. Such an edge into a vertex already settled at the
+// same distance is left out, so the search runs on past the target through
+// its distance and the count is reported as incomplete if one of those edges
+// leads into the DAG above the target. Counts saturate at ULLONG_MAX.
+void equalCostPaths(struct Graph *graph, struct SearchWorkspace *workspace, int src, int dest, int limit)
+{
+    struct ShortestPathDag dag;
+    dag.head = (int *)malloc(graph->V * sizeof(int));
+    dag.count = (unsigned long long *)malloc(graph->V * sizeof(unsigned long long));
+    dag.edgeCount = 0;
+    dag.edgeCapacity = 64;
+    dag.edges = (struct TightEdge *)malloc(dag.edgeCapacity * sizeof(struct TightEdge));
+    if (!dag.head || !dag.count || !dag.edges)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+
+    int s = toInternal(graph, src), t = toInternal(graph, dest);
+    int *distance = workspace->distance;
+    beginSearch(workspace);
+    touchVertex(workspace, s);
+    distance[s] = 0;
+    dag.head[s] = -1;
+    dag.count[s] = 1;
+    heapPush(workspace->heap, 0, s);
+    bool reached = false, incomplete = false;
+    int droppedCount = 0, droppedCapacity = 16;
+    int *dropped = (int *)malloc(droppedCapacity * sizeof(int));
+    if (!dropped)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    while (workspace->heap->size > 0)
+    {
+        struct HeapEntry entry = heapPop(workspace->heap);
+        int u = entry.vertex;
+        if (reached && entry.key > distance[t])
+        {
+            break;
+        }
+        if (workspace->visited[u])
+        {
+            continue;
+        }
+        workspace->visited[u] = true;
+        reached = reached || u == t;
+
+        struct EdgeCursor cursor;
+        int v, weight;
+        enum Direction direction;
+        firstEdge(graph, u, &cursor);
+        while (nextEdge(&cursor, &v, &weight, &direction))
+        {
+            bool fresh = workspace->stamp[v] != workspace->generation;
+            touchVertex(workspace, v);
+            if (fresh)
+            {
+                dag.head[v] = -1;
+                dag.count[v] = 0;
+            }
+            if (workspace->visited[v] && v != u && distance[u] + weight == distance[v])
+            {
+                if (droppedCount == droppedCapacity)
+                {
+                    droppedCapacity *= 2;
+                    dropped = (int *)realloc(dropped, droppedCapacity * sizeof(int));
+                    if (!dropped)
+                    {
+                        perror("Memory allocation failed");
+                        exit(EXIT_FAILURE);
+                    }
+                }
+                dropped[droppedCount++] = v;
+            }
+            if (workspace->visited[v] || distance[u] + weight > distance[v] || distance[u] + weight >= 10000)
+            {
+                continue;
+            }
+            if (distance[u] + weight < distance[v])
+            {
+                distance[v] = distance[u] + weight;
+                dag.head[v] = -1;
+                dag.count[v] = 0;
+                heapPush(workspace->heap, distance[v], v);
+            }
+            if (dag.edgeCount == dag.edgeCapacity)
+            {
+                dag.edgeCapacity *= 2;
+                dag.edges = (struct TightEdge *)realloc(dag.edges, dag.edgeCapacity * sizeof(struct TightEdge));
+                if (!dag.edges)
+                {
+                    perror("Memory allocation failed");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            struct TightEdge *edge = &dag.edges[dag.edgeCount];
+            edge->from = u;
+            edge->direction = direction;
+            edge->next = dag.head[v];
+            dag.head[v] = dag.edgeCount++;
+            dag.count[v] = dag.count[v] > ULLONG_MAX - dag.count[u] ? ULLONG_MAX : dag.count[v] + dag.count[u];
+        }
+    }
+
+    // Marks t and its DAG ancestors with parent -2, using path as the stack.
+    touchVertex(workspace, t);
+    if (workspace->visited[t] && droppedCount > 0)
+    {
+        int *stack = workspace->path, top = 0;
+        workspace->parent[t] = -2;
+        stack[top++] = t;
+        while (top > 0)
+        {
+            int v = stack[--top];
+            for (int k = dag.head[v]; k != -1; k = dag.edges[k].next)
+            {
+                int w = dag.edges[k].from;
+                if (workspace->parent[w] != -2)
+                {
+                    workspace->parent[w] = -2;
+                    stack[top++] = w;
+                }
+            }
+        }
+        for (int k = 0; k < droppedCount && !incomplete; k++)
+        {
+            incomplete = workspace->parent[dropped[k]] == -2;
+        }
+    }
+    free(dropped);
+
+    if (!workspace->visited[t])
+    {
+        printf("No route from node %lld to node %lld.\n", mapId(graph, src), mapId(graph, dest));
+    }
+    else
+    {
+        printf("Shortest distance from %lld to %lld: %d, %s%llu shortest paths%s\n", mapId(graph, src),
+               mapId(graph, dest), distance[t], dag.count[t] == ULLONG_MAX || incomplete ? "at least " : "",
+               dag.count[t], incomplete ? " (zero-weight edges present, count may be incomplete)" : "");
+        int *path = workspace->path;
+        int *choice = (int *)malloc(graph->V * sizeof(int));
+        if (!choice)
+        {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+        path[0] = t;
+        int length = extendTightPath(&dag, path, choice, 0, s);
+        for (int listed = 0; listed < limit && length > 0; listed++)
+        {
+            printf("Path %d: ", listed + 1);
+            for (int k = length - 1; k >= 0; k--)
+            {
+                printf("%lld", vertexId(graph, path[k]));
+                if (k > 0)
+                {
+                    printf(" (%s) -> ", directionName(dag.edges[choice[k - 1]].direction));
+                }
+            }
+            printf("\n");
+            length = nextTightPath(&dag, path, choice, length, s);
+        }
+        free(choice);
+    }
+
+    free(dag.head);
+    free(dag.count);
+    free(dag.edges);
+}
+
+
+int compareVertexDegree(const void *a, const void *b)
+{
+    const struct VertexDegree *x = (const struct VertexDegree *)a;
+    const struct VertexDegree *y = (const struct VertexDegree *)b;
+    if (x->degree != y->degree)
+    {
+        return x->degree - y->degree;
+    }
+    return x->vertex - y->vertex;
+}
+
+
+// Hub labelling (pruned landmark labelling). Vertices are ranked by degree
+// and each one in turn runs a forward and a backward Dijkstra that stops at
+// every vertex whose distance is already answered by the labels so far.
+// Batches of hubs run in parallel, pruning only against labels committed by
+// earlier batches; that can keep a few extra entries but never loses one.
+void appendLabel(struct LabelList *list, int hub, int distance, int parent)
+{
+    if (list->count == list->capacity)
+    {
+        list->capacity = list->capacity ? list->capacity * 2 : 4;
+        list->hubs = (int *)realloc(list->hubs, list->capacity * sizeof(int));
+        list->distances = (int *)realloc(list->distances, list->capacity * sizeof(int));
+        list->parents = (int *)realloc(list->parents, list->capacity * sizeof(int));
+        if (!list->hubs || !list->distances || !list->parents)
+        {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    list->hubs[list->count] = hub;
+    list->distances[list->count] = distance;
+    list->parents[list->count] = parent;
+    list->count++;
+}
+
+
+void prunedLabelSearch(struct LabelBuilder *builder, struct LabelWorkspace *workspace, int task)
+{
+    int rank = builder->batchStart + task / 2;
+    bool forward = task % 2 == 0;
+    int hub = builder->rankToVertex[rank];
+    struct CSRGraph *csr = forward ? builder->forward : builder->backward;
+    struct LabelList *own = forward ? &builder->out[hub] : &builder->in[hub];
+    struct LabelList *labels = forward ? builder->in : builder->out;
+    struct LabelList *result = &builder->tasks[task];
+    int touchedCount = 0;
+
+    result->count = 0;
+    for (int k = 0; k < own->count; k++)
+    {
+        workspace->hubDistance[own->hubs[k]] = own->distances[k];
+    }
+
+    workspace->distance[hub] = 0;
+    workspace->parent[hub] = -1;
+    workspace->touched[touchedCount++] = hub;
+    heapPush(workspace->heap, 0, hub);
+
+    while (workspace->heap->size > 0)
+    {
+        struct HeapEntry entry = heapPop(workspace->heap);
+        int u = entry.vertex;
+        int d = entry.key;
+        if (d > workspace->distance[u])
+        {
+            continue;
+        }
+
+        struct LabelList *list = &labels[u];
+        bool covered = false;
+        for (int k = 0; k < list->count && !covered; k++)
+        {
+            int viaHub = workspace->hubDistance[list->hubs[k]];
+            covered = viaHub != INT_MAX && viaHub + list->distances[k] <= d;
+        }
+        if (covered)
+        {
+            continue;
+        }
+        appendLabel(result, u, d, workspace->parent[u]);
+
+        for (int k = csr->offsets[u]; k < csr->offsets[u + 1]; k++)
+        {
+            int v = csr->targets[k];
+            int nd = d + csr->weights[k];
+            if (nd < workspace->distance[v])
+            {
+                if (workspace->distance[v] == INT_MAX)
+                {
+                    workspace->touched[touchedCount++] = v;
+                }
+                workspace->distance[v] = nd;
+                workspace->parent[v] = u;
+                heapPush(workspace->heap, nd, v);
+            }
+        }
+    }
+
+    for (int k = 0; k < touchedCount; k++)
+    {
+        workspace->distance[workspace->touched[k]] = INT_MAX;
+    }
+    for (int k = 0; k < own->count; k++)
+    {
+        workspace->hubDistance[own->hubs[k]] = INT_MAX;
+    }
+}
+
+
+void *labelWorker(void *arg)
+{
+    struct LabelWorker *worker = (struct LabelWorker *)arg;
+    struct LabelBuilder *builder = worker->builder;
+    while (true)
+    {
+        pthread_barrier_wait(&builder->start);
+        if (builder->finished)
+        {
+            break;
+        }
+        int task;
+        while ((task = atomic_fetch_add(&builder->nextTask, 1)) < builder->taskCount)
+        {
+            prunedLabelSearch(builder, &worker->workspace, task);
+        }
+        pthread_barrier_wait(&builder->done);
+    }
+    return NULL;
+}
+
+
+int varintSize(unsigned int value)
+{
+    int size = 1;
+    while (value >= 0x80)
+    {
+        value >>= 7;
+        size++;
+    }
+    return size;
+}
+
+
+void writeVarint(FILE *file, unsigned int value)
+{
+    while (value >= 0x80)
+    {
+        fputc((int)((value & 0x7F) | 0x80), file);
+        value >>= 7;
+    }
+    fputc((int)value, file);
+}
+
+
+uint64_t labelListSize(struct LabelList *list, bool parents)
+{
+    uint64_t size = 0;
+    int previous = 0;
+    for (int k = 0; k < list->count; k++)
+    {
+        size += varintSize((unsigned int)(list->hubs[k] - previous));
+        size += varintSize((unsigned int)list->distances[k]);
+        if (parents)
+        {
+            size += varintSize((unsigned int)(list->parents[k] + 1));
+        }
+        previous = list->hubs[k];
+    }
+    return size;
+}
+
+
+void writeLabelList(FILE *file, struct LabelList *list, bool parents)
+{
+    int previous = 0;
+    for (int k = 0; k < list->count; k++)
+    {
+        writeVarint(file, (unsigned int)(list->hubs[k] - previous));
+        writeVarint(file, (unsigned int)list->distances[k]);
+        if (parents)
+        {
+            writeVarint(file, (unsigned int)(list->parents[k] + 1));
+        }
+        previous = list->hubs[k];
+    }
+}
+
+
+void writePadding(FILE *file, uint64_t *position)
+{
+    while (*position % 8 != 0)
+    {
+        fputc(0, file);
+        (*position)++;
+    }
+}
+
+
+// File layout (all sections 8-byte aligned so the file can be mapped as is):
+// header, external ID per vertex, vertex per hub rank, out/in byte offsets,
+// then the varint label data.
+bool saveHubLabels(struct Graph *graph, struct LabelBuilder *builder, const char *filename, bool parents,
+                   uint64_t *fileSize)
+{
+    int V = graph->V;
+    FILE *file = fopen(filename, "wb");
+    if (!file)
+    {
+        perror("Failed to open the file for writing");
+        return false;
+    }
+
+    uint64_t *outOffsets = (uint64_t *)malloc((V + 1) * sizeof(uint64_t));
+    uint64_t *inOffsets = (uint64_t *)malloc((V + 1) * sizeof(uint64_t));
+    int32_t *external = (int32_t *)malloc((V + 1) * sizeof(int32_t));
+    uint32_t *hubVertex = (uint32_t *)malloc((V + 1) * sizeof(uint32_t));
+    if (!outOffsets || !inOffsets || !external || !hubVertex)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+
+    uint64_t dataSize = 0;
+    for (int v = 0; v < V; v++)
+    {
+        outOffsets[v] = dataSize;
+        dataSize += labelListSize(&builder->out[v], parents);
+    }
+    outOffsets[V] = dataSize;
+    for (int v = 0; v < V; v++)
+    {
+        inOffsets[v] = dataSize;
+        dataSize += labelListSize(&builder->in[v], parents);
+    }
+    inOffsets[V] = dataSize;
+    for (int v = 0; v < V; v++)
+    {
+        external[v] = toExternal(graph, v);
+        hubVertex[v] = (uint32_t)builder->rankToVertex[v];
+    }
+
+    struct HubLabelHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "HUBLBL1", 8);
+    header.V = (uint32_t)V;
+    header.flags = parents ? 1 : 0;
+    uint64_t position = sizeof(header);
+    header.externalPos = position;
+    position += V * sizeof(int32_t);
+    position = (position + 7) / 8 * 8;
+    header.hubVertexPos = position;
+    position += V * sizeof(uint32_t);
+    position = (position + 7) / 8 * 8;
+    header.outOffsetsPos = position;
+    position += (V + 1) * sizeof(uint64_t);
+    header.inOffsetsPos = position;
+    position += (V + 1) * sizeof(uint64_t);
+    header.dataPos = position;
+    header.dataSize = dataSize;
+
+    position = sizeof(header);
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(external, sizeof(int32_t), V, file);
+    position += V * sizeof(int32_t);
+    writePadding(file, &position);
+    fwrite(hubVertex, sizeof(uint32_t), V, file);
+    position += V * sizeof(uint32_t);
+    writePadding(file, &position);
+    fwrite(outOffsets, sizeof(uint64_t), V + 1, file);
+    fwrite(inOffsets, sizeof(uint64_t), V + 1, file);
+    for (int v = 0; v < V; v++)
+    {
+        writeLabelList(file, &builder->out[v], parents);
+    }
+    for (int v = 0; v < V; v++)
+    {
+        writeLabelList(file, &builder->in[v], parents);
+    }
+
+    bool ok = !ferror(file);
+    if (fclose(file) != 0 || !ok)
+    {
+        perror("Failed to write the hub label file");
+        ok = false;
+    }
+    *fileSize = header.dataPos + dataSize;
+
+    free(outOffsets);
+    free(inOffsets);
+    free(external);
+    free(hubVertex);
+    return ok;
+}
+
+
+void buildHubLabels(struct Graph *graph, const char *filename, bool parents)
+{
+    int V = graph->V;
+    struct CSRGraph *forward = buildCSR(graph, false);
+    for (int k = 0; k < forward->E; k++)
+    {
+        if (forward->weights[k] < 0)
+        {
+            printf("Hub labels need non-negative distances.\n");
+            freeCSR(forward);
+            return;
+        }
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    struct LabelBuilder builder;
+    builder.forward = forward;
+    builder.backward = buildCSR(graph, true);
+    builder.rankToVertex = (int *)malloc((V + 1) * sizeof(int));
+    builder.in = (struct LabelList *)calloc(V + 1, sizeof(struct LabelList));
+    builder.out = (struct LabelList *)calloc(V + 1, sizeof(struct LabelList));
+    struct VertexDegree *ranking = (struct VertexDegree *)malloc((V + 1) * sizeof(struct VertexDegree));
+    if (!builder.rankToVertex || !builder.in || !builder.out || !ranking)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+
+    // Negated so that the best-connected vertices become the first hubs.
+    for (int v = 0; v < V; v++)
+    {
+        ranking[v].degree = -(forward->offsets[v + 1] - forward->offsets[v] +
+                              builder.backward->offsets[v + 1] - builder.backward->offsets[v]);
+        ranking[v].vertex = v;
+    }
+    qsort(ranking, V, sizeof(struct VertexDegree), compareVertexDegree);
+
+    // Shuffle ties deterministically: after reordering, neighbours have
+    // consecutive IDs and would otherwise become consecutive hubs.
+    unsigned int seed = 2463534242u;
+    for (int first = 0, last; first < V; first = last)
+    {
+        for (last = first + 1; last < V && ranking[last].degree == ranking[first].degree; last++)
+        {
+        }
+        for (int r = last - 1; r > first; r--)
+        {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            int pick = first + (int)(seed % (unsigned int)(r - first + 1));
+            struct VertexDegree swap = ranking[r];
+            ranking[r] = ranking[pick];
+            ranking[pick] = swap;
+        }
+    }
+    for (int r = 0; r < V; r++)
+    {
+        builder.rankToVertex[r] = ranking[r].vertex;
+    }
+    free(ranking);
+
+    int threads = availableThreads();
+    int maxBatch = threads * 8;
+    builder.tasks = (struct LabelList *)calloc(2 * maxBatch, sizeof(struct LabelList));
+    struct LabelWorker *workers = (struct LabelWorker *)malloc(threads * sizeof(struct LabelWorker));
+    pthread_t *ids = (pthread_t *)malloc(threads * sizeof(pthread_t));
+    if (!builder.tasks || !workers || !ids)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    builder.finished = false;
+    pthread_barrier_init(&builder.start, NULL, threads);
+    pthread_barrier_init(&builder.done, NULL, threads);
+
+    for (int t = 0; t < threads; t++)
+    {
+        struct LabelWorkspace *workspace = &workers[t].workspace;
+        workers[t].builder = &builder;
+        workspace->distance = (int *)malloc(V * sizeof(int));
+        workspace->parent = (int *)malloc(V * sizeof(int));
+        workspace->hubDistance = (int *)malloc(V * sizeof(int));
+        workspace->touched = (int *)malloc(V * sizeof(int));
+        workspace->heap = createMinHeap(64);
+        if (!workspace->distance || !workspace->parent || !workspace->hubDistance || !workspace->touched)
+        {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+        for (int v = 0; v < V; v++)
+        {
+            workspace->distance[v] = INT_MAX;
+            workspace->hubDistance[v] = INT_MAX;
+        }
+        if (t > 0)
+        {
+            pthread_create(&ids[t], NULL, labelWorker, &workers[t]);
+        }
+    }
+
+    // The first hubs prune the most, so batches start small and grow.
+    int processed = 0;
+    while (processed < V)
+    {
+        int batch = processed < 16 ? 1 : processed / 16;
+        if (batch > maxBatch)
+        {
+            batch = maxBatch;
+        }
+        if (batch > V - processed)
+        {
+            batch = V - processed;
+        }
+        builder.batchStart = processed;
+        builder.taskCount = 2 * batch;
+        atomic_store(&builder.nextTask, 0);
+
+        pthread_barrier_wait(&builder.start);
+        int task;
+        while ((task = atomic_fetch_add(&builder.nextTask, 1)) < builder.taskCount)
+        {
+            prunedLabelSearch(&builder, &workers[0].workspace, task);
+        }
+        pthread_barrier_wait(&builder.done);
+
+        for (task = 0; task < builder.taskCount; task++)
+        {
+            int rank = processed + task / 2;
+            struct LabelList *labels = task % 2 == 0 ? builder.in : builder.out;
+            struct LabelList *result = &builder.tasks[task];
+            for (int k = 0; k < result->count; k++)
+            {
+                appendLabel(&labels[result->hubs[k]], rank, result->distances[k], result->parents[k]);
+            }
+        }
+        processed += batch;
+    }
+
+    builder.finished = true;
+    pthread_barrier_wait(&builder.start);
+    for (int t = 1; t < threads; t++)
+    {
+        pthread_join(ids[t], NULL);
+    }
+    double seconds = elapsedSeconds(&start);
+
+    long long outTotal = 0, inTotal = 0;
+    int outMax = 0, inMax = 0;
+    for (int v = 0; v < V; v++)
+    {
+        outTotal += builder.out[v].count;
+        inTotal += builder.in[v].count;
+        if (builder.out[v].count > outMax)
+        {
+            outMax = builder.out[v].count;
+        }
+        if (builder.in[v].count > inMax)
+        {
+            inMax = builder.in[v].count;
+        }
+    }
+
+    uint64_t fileSize = 0;
+    if (saveHubLabels(graph, &builder, filename, parents, &fileSize))
+    {
+        printf("Hub labels built in %.3f s using %d threads.\n", seconds, threads);
+        printf("Forward labels: %.1f entries on average, %d at most\n", V ? (double)outTotal / V : 0.0, outMax);
+        printf("Backward labels: %.1f entries on average, %d at most\n", V ? (double)inTotal / V : 0.0, inMax);
+        printf("Saved %llu bytes to %s (%.1f bytes per vertex%s)\n", (unsigned long long)fileSize, filename,
+               V ? (double)fileSize / V : 0.0, parents ? ", with path retrieval" : "");
+    }
+
+    for (int t = 0; t < threads; t++)
+    {
+        free(workers[t].workspace.distance);
+        free(workers[t].workspace.parent);
+        free(workers[t].workspace.hubDistance);
+        free(workers[t].workspace.touched);
+        freeMinHeap(workers[t].workspace.heap);
+    }
+    for (int k = 0; k < 2 * maxBatch; k++)
+    {
+        free(builder.tasks[k].hubs);
+        free(builder.tasks[k].distances);
+        free(builder.tasks[k].parents);
+    }
+    for (int v = 0; v < V; v++)
+    {
+        free(builder.in[v].hubs);
+        free(builder.in[v].distances);
+        free(builder.in[v].parents);
+        free(builder.out[v].hubs);
+        free(builder.out[v].distances);
+        free(builder.out[v].parents);
+    }
+    pthread_barrier_destroy(&builder.start);
+    pthread_barrier_destroy(&builder.done);
+    free(builder.tasks);
+    free(builder.in);
+    free(builder.out);
+    free(builder.rankToVertex);
+    free(workers);
+    free(ids);
+    freeCSR(builder.forward);
+    freeCSR(builder.backward);
+}
+
+
+void freeHubLabels(struct HubLabels *labels)
+{
+    if (labels)
+    {
+        munmap(labels->map, labels->mapSize);
+        free(labels->fileIndex);
+        free(labels);
+    }
+}
+
+
+// True if size bytes at position lie inside a file of fileSize bytes, without
+// letting the sum wrap around.
+bool sectionInFile(uint64_t position, uint64_t size, uint64_t fileSize)
+{
+    return position <= fileSize && size <= fileSize - position;
+}
+
+
+// Offsets into the label data must start at first, never go back and stay
+// inside it, so every label list lies within the mapping.
+bool validLabelOffsets(const uint64_t *offsets, int V, uint64_t first, uint64_t dataSize)
+{
+    if (offsets[0] != first)
+    {
+        return false;
+    }
+    for (int v = 0; v < V; v++)
+    {
+        if (offsets[v + 1] < offsets[v])
+        {
+            return false;
+        }
+    }
+    return offsets[V] <= dataSize;
+}
+
+
+struct HubLabels *loadHubLabels(const char *filename)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        perror("Failed to open the hub label file");
+        return NULL;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(struct HubLabelHeader))
+    {
+        printf("Invalid hub label file.\n");
+        close(fd);
+        return NULL;
+    }
+    void *map = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        perror("Failed to map the hub label file");
+        return NULL;
+    }
+
+    const struct HubLabelHeader *header = (const struct HubLabelHeader *)map;
+    const unsigned char *base = (const unsigned char *)map;
+    uint64_t fileSize = (uint64_t)info.st_size;
+    uint64_t V = header->V;
+    if (memcmp(header->magic, "HUBLBL1", 8) != 0 || V > INT_MAX - 1 ||
+        header->externalPos % sizeof(int32_t) || header->hubVertexPos % sizeof(uint32_t) ||
+        header->outOffsetsPos % sizeof(uint64_t) || header->inOffsetsPos % sizeof(uint64_t) ||
+        !sectionInFile(header->externalPos, V * sizeof(int32_t), fileSize) ||
+        !sectionInFile(header->hubVertexPos, V * sizeof(uint32_t), fileSize) ||
+        !sectionInFile(header->outOffsetsPos, (V + 1) * sizeof(uint64_t), fileSize) ||
+        !sectionInFile(header->inOffsetsPos, (V + 1) * sizeof(uint64_t), fileSize) ||
+        !sectionInFile(header->dataPos, header->dataSize, fileSize) ||
+        !validLabelOffsets((const uint64_t *)(base + header->outOffsetsPos), (int)V, 0, header->dataSize) ||
+        !validLabelOffsets((const uint64_t *)(base + header->inOffsetsPos), (int)V,
+                           ((const uint64_t *)(base + header->outOffsetsPos))[V], header->dataSize))
+    {
+        printf("Invalid hub label file.\n");
+        munmap(map, info.st_size);
+        return NULL;
+    }
+
+    struct HubLabels *labels = (struct HubLabels *)malloc(sizeof(struct HubLabels));
+    if (!labels)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    labels->map = map;
+    labels->mapSize = info.st_size;
+    labels->V = (int)header->V;
+    labels->parents = (header->flags & 1) != 0;
+    labels->external = (const int32_t *)(base + header->externalPos);
+    labels->hubVertex = (const uint32_t *)(base + header->hubVertexPos);
+    labels->outOffsets = (const uint64_t *)(base + header->outOffsetsPos);
+    labels->inOffsets = (const uint64_t *)(base + header->inOffsetsPos);
+    labels->data = base + header->dataPos;
+
+    labels->fileIndex = (int *)malloc((labels->V + 1) * sizeof(int));
+    if (!labels->fileIndex)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    for (int v = 0; v < labels->V; v++)
+    {
+        labels->fileIndex[v] = -1;
+    }
+    for (int v = 0; v < labels->V; v++)
+    {
+        int external = labels->external[v];
+        if (external < 0 || external >= labels->V || labels->fileIndex[external] != -1 ||
+            labels->hubVertex[v] >= (uint32_t)labels->V)
+        {
+            printf("Invalid hub label file.\n");
+            freeHubLabels(labels);
+            return NULL;
+        }
+        labels->fileIndex[external] = v;
+    }
+    return labels;
+}
+
+
+void firstLabel(struct HubLabels *labels, int vertex, bool out, struct LabelCursor *cursor)
+{
+    const uint64_t *offsets = out ? labels->outOffsets : labels->inOffsets;
+    cursor->pos = labels->data + offsets[vertex];
+    cursor->end = labels->data + offsets[vertex + 1];
+    cursor->parents = labels->parents;
+    cursor->hub = 0;
+}
+
+
+bool nextLabel(struct LabelCursor *cursor)
+{
+    if (cursor->pos == cursor->end)
+    {
+        return false;
+    }
+    cursor->hub += (int)readVarint(&cursor->pos);
+    cursor->distance = (int)readVarint(&cursor->pos);
+    cursor->parent = cursor->parents ? (int)readVarint(&cursor->pos) - 1 : -1;
+    return true;
+}
+
+
+// Merge-intersects the forward label of src with the backward label of dest.
+int hubLabelDistance(struct HubLabels *labels, int src, int dest, int *bestHub)
+{
+    struct LabelCursor out, in;
+    int best = INT_MAX;
+    firstLabel(labels, src, true, &out);
+    firstLabel(labels, dest, false, &in);
+    bool more = nextLabel(&out) && nextLabel(&in);
+    while (more)
+    {
+        if (out.hub == in.hub)
+        {
+            if (out.distance + in.distance < best)
+            {
+                best = out.distance + in.distance;
+                *bestHub = out.hub;
+            }
+            more = nextLabel(&out) && nextLabel(&in);
+        }
+        else if (out.hub < in.hub)
+        {
+            more = nextLabel(&out);
+        }
+        else
+        {
+            more = nextLabel(&in);
+        }
+    }
+    return best;
+}
+
+
+int labelParent(struct HubLabels *labels, int vertex, bool out, int hub)
+{
+    struct LabelCursor cursor;
+    firstLabel(labels, vertex, out, &cursor);
+    while (nextLabel(&cursor) && cursor.hub <= hub)
+    {
+        if (cursor.hub == hub)
+        {
+            return cursor.parent;
+        }
+    }
+    return -1;
+}
+
+
+// Every vertex a pruned search expanded got the hub in its label, so the
+// stored parents can be followed from both ends up to the hub. Hubs and
+// parents come from the label data, so they are range-checked before use.
+int hubLabelPath(struct HubLabels *labels, int src, int dest, int hub, int path[])
+{
+    if (hub < 0 || hub >= labels->V)
+    {
+        return 0;
+    }
+    int hubVertex = (int)labels->hubVertex[hub];
+    int length = 0;
+    for (int v = src; v != hubVertex && v >= 0 && v < labels->V && length < labels->V;
+         v = labelParent(labels, v, true, hub))
+    {
+        path[length++] = v;
+    }
+    path[length++] = hubVertex;
+
+    int tail = length;
+    for (int v = dest; v != hubVertex && v >= 0 && v < labels->V && length < 2 * labels->V;
+         v = labelParent(labels, v, false, hub))
+    {
+        path[length++] = v;
+    }
+    for (int i = tail, j = length - 1; i < j; i++, j--)
+    {
+        int swap = path[i];
+        path[i] = path[j];
+        path[j] = swap;
+    }
+    return length;
+}
+
+
+void queryHubLabels(struct Graph *graph, struct HubLabels *labels, int src, int dest)
+{
+    if (src < 0 || src >= labels->V || dest < 0 || dest >= labels->V ||
+        labels->fileIndex[src] < 0 || labels->fileIndex[dest] < 0)
+    {
+        printf("Invalid source or destination node.\n");
+        return;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int hub = -1;
+    int distance = hubLabelDistance(labels, labels->fileIndex[src], labels->fileIndex[dest], &hub);
+    double micros = elapsedSeconds(&start) * 1e6;
+
+    if (distance == INT_MAX)
+    {
+        printf("No route from node %lld to node %lld (%.2f us).\n", mapId(graph, src), mapId(graph, dest), micros);
+        return;
+    }
+    printf("Distance from %lld to %lld: %d (%.2f us)\n", mapId(graph, src), mapId(graph, dest), distance, micros);
+    if (!labels->parents)
+    {
+        return;
+    }
+
+    int *path = (int *)malloc(2 * (labels->V + 1) * sizeof(int));
+    if (!path)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    int length = hubLabelPath(labels, labels->fileIndex[src], labels->fileIndex[dest], hub, path);
+    printf("Path: ");
+    for (int i = 0; i < length; i++)
+    {
+        int vertex = labels->external[path[i]];
+        printf("%lld", mapId(graph, vertex));
+        if (i < length - 1)
+        {
+            int edgeDistance;
+            enum Direction direction;
+            int next = labels->external[path[i + 1]];
+            if (vertex < graph->V && next < graph->V &&
+                findShortestEdge(graph, toInternal(graph, vertex), toInternal(graph, next), &edgeDistance, &direction))
+            {
+                printf(" (%s)", directionName(direction));
+            }
+            printf(" -> ");
+        }
+    }
+    printf("\n");
+    free(path);
+}
+
+
+// Customizable route planning. The topology is partitioned once into nested
+// cells (level 0 is the finest). Customization stores, for every cell, the
+// shortest distance from each entry vertex to each exit vertex; only cells
+// touched by a distance update are recomputed. Queries use the original
+// edges in the cells of the source and target and the cell cliques elsewhere.
+struct OverlayWorkspace *createOverlayWorkspace(int V)
+{
+    struct OverlayWorkspace *workspace = (struct OverlayWorkspace *)malloc(sizeof(struct OverlayWorkspace));
+    if (!workspace)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    workspace->distance = (int *)malloc(V * sizeof(int));
+    workspace->parent = (int *)malloc(V * sizeof(int));
+    workspace->parentLevel = (signed char *)malloc(V);
+    workspace->touched = (int *)malloc(V * sizeof(int));
+    workspace->touchedCount = 0;
+    workspace->heap = createMinHeap(64);
+    if (!workspace->distance || !workspace->parent || !workspace->parentLevel || !workspace->touched)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    for (int v = 0; v < V; v++)
+    {
+        workspace->distance[v] = INT_MAX;
+    }
+    return workspace;
+}
+
+
+void freeOverlayWorkspace(struct OverlayWorkspace *workspace)
+{
+    free(workspace->distance);
+    free(workspace->parent);
+    free(workspace->parentLevel);
+    free(workspace->touched);
+    freeMinHeap(workspace->heap);
+    free(workspace);
+}
+
+
+void resetOverlayWorkspace(struct OverlayWorkspace *workspace)
+{
+    for (int k = 0; k < workspace->touchedCount; k++)
+    {
+        workspace->distance[workspace->touched[k]] = INT_MAX;
+    }
+    workspace->touchedCount = 0;
+    workspace->heap->size = 0;
+}
+
+
+void relaxOverlay(struct OverlayWorkspace *workspace, int v, long long distance, int parent, int level)
+{
+    if (distance < workspace->distance[v])
+    {
+        if (workspace->distance[v] == INT_MAX)
+        {
+            workspace->touched[workspace->touchedCount++] = v;
+        }
+        workspace->distance[v] = (int)distance;
+        workspace->parent[v] = parent;
+        workspace->parentLevel[v] = (signed char)level;
+        heapPush(workspace->heap, (int)distance, v);
+    }
+}
+
+
+void relaxClique(struct Overlay *overlay, struct OverlayWorkspace *workspace, int level, int u, int d)
+{
+    struct OverlayLevel *cells = &overlay->level[level];
+    int cell = cells->cell[u];
+    int exitCount = cells->exitOffsets[cell + 1] - cells->exitOffsets[cell];
+    int *row = cells->weights + cells->matrixOffsets[cell] + (long long)cells->entryIndex[u] * exitCount;
+    for (int k = 0; k < exitCount; k++)
+    {
+        if (row[k] != INT_MAX)
+        {
+            relaxOverlay(workspace, cells->exits[cells->exitOffsets[cell] + k], (long long)d + row[k], u, level);
+        }
+    }
+}
+
+
+// Dijkstra from an entry of a cell, confined to that cell. On level 0 it
+// uses the original edges; above that it uses the subcell cliques plus the
+// original edges between subcells.
+void cellSearch(struct Overlay *overlay, struct OverlayWorkspace *workspace, int level, int source)
+{
+    struct CSRGraph *csr = overlay->forward;
+    int *cell = overlay->level[level].cell;
+    int home = cell[source];
+
+    relaxOverlay(workspace, source, 0, -1, -1);
+    while (workspace->heap->size > 0)
+    {
+        struct HeapEntry entry = heapPop(workspace->heap);
+        int u = entry.vertex;
+        if (entry.key > workspace->distance[u])
+        {
+            continue;
+        }
+
+        if (level == 0)
+        {
+            for (int k = csr->offsets[u]; k < csr->offsets[u + 1]; k++)
+            {
+                if (cell[csr->targets[k]] == home)
+                {
+                    relaxOverlay(workspace, csr->targets[k], (long long)entry.key + csr->weights[k], u, -1);
+                }
+            }
+            continue;
+        }
+
+        struct OverlayLevel *sub = &overlay->level[level - 1];
+        if (sub->entryIndex[u] >= 0)
+        {
+            relaxClique(overlay, workspace, level - 1, u, entry.key);
+        }
+        if (sub->exitIndex[u] >= 0)
+        {
+            for (int k = csr->offsets[u]; k < csr->offsets[u + 1]; k++)
+            {
+                int v = csr->targets[k];
+                if (sub->cell[v] != sub->cell[u] && cell[v] == home)
+                {
+                    relaxOverlay(workspace, v, (long long)entry.key + csr->weights[k], u, -1);
+                }
+            }
+        }
+    }
+}
+
+
+void customizeCell(struct Overlay *overlay, struct OverlayWorkspace *workspace, int level, int cell)
+{
+    struct OverlayLevel *cells = &overlay->level[level];
+    int exitCount = cells->exitOffsets[cell + 1] - cells->exitOffsets[cell];
+    int *row = cells->weights + cells->matrixOffsets[cell];
+    for (int e = cells->entryOffsets[cell]; e < cells->entryOffsets[cell + 1]; e++)
+    {
+        cellSearch(overlay, workspace, level, cells->entries[e]);
+        for (int k = 0; k < exitCount; k++)
+        {
+            *row++ = workspace->distance[cells->exits[cells->exitOffsets[cell] + k]];
+        }
+        resetOverlayWorkspace(workspace);
+    }
+}
+
+
+void *customizeWorker(void *arg)
+{
+    struct CustomizeTask *task = (struct CustomizeTask *)arg;
+    struct OverlayLevel *cells = &task->overlay->level[task->level];
+    struct OverlayWorkspace *workspace = createOverlayWorkspace(task->overlay->forward->V);
+    int cell;
+    while ((cell = atomic_fetch_add(task->nextCell, 1)) < cells->cellCount)
+    {
+        if (cells->dirty[cell])
+        {
+            customizeCell(task->overlay, workspace, task->level, cell);
+            cells->dirty[cell] = false;
+        }
+    }
+    freeOverlayWorkspace(workspace);
+    return NULL;
+}
+
+
+// Levels depend on the level below, so they run in order; the dirty cells of
+// one level are shared out over the threads.
+void customizeOverlay(struct Overlay *overlay)
+{
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int threads = availableThreads();
+    pthread_t *ids = (pthread_t *)malloc(threads * sizeof(pthread_t));
+    struct CustomizeTask *tasks = (struct CustomizeTask *)malloc(threads * sizeof(struct CustomizeTask));
+    if (!ids || !tasks)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+
+    int recomputed = 0;
+    for (int level = 0; level < overlay->levels; level++)
+    {
+        struct OverlayLevel *cells = &overlay->level[level];
+        for (int c = 0; c < cells->cellCount; c++)
+        {
+            recomputed += cells->dirty[c];
+        }
+        atomic_int nextCell;
+        atomic_init(&nextCell, 0);
+        for (int t = 0; t < threads; t++)
+        {
+            tasks[t].overlay = overlay;
+            tasks[t].level = level;
+            tasks[t].nextCell = &nextCell;
+            pthread_create(&ids[t], NULL, customizeWorker, &tasks[t]);
+        }
+        for (int t = 0; t < threads; t++)
+        {
+            pthread_join(ids[t], NULL);
+        }
+    }
+    free(ids);
+    free(tasks);
+    printf("Customized %d cells in %.3f s using %d threads.\n", recomputed, elapsedSeconds(&start), threads);
+}
+
+
+// Visits every vertex of perm[lo, hi) in BFS order over the undirected view
+// of the range, starting at start and restarting at unseen vertices.
+void traverseRange(struct CSRGraph *forward, struct CSRGraph *backward, int *perm, int *position,
+                   int *seen, int *queue, int stamp, int lo, int hi, int start)
+{
+    int head = 0, tail = 0;
+    for (int scan = lo - 1; scan < hi; scan++)
+    {
+        int root = scan < lo ? start : perm[scan];
+        if (seen[root] == stamp)
+        {
+            continue;
+        }
+        seen[root] = stamp;
+        queue[tail++] = root;
+        while (head < tail)
+        {
+            int u = queue[head++];
+            for (int side = 0; side < 2; side++)
+            {
+                struct CSRGraph *csr = side == 0 ? forward : backward;
+                for (int k = csr->offsets[u]; k < csr->offsets[u + 1]; k++)
+                {
+                    int v = csr->targets[k];
+                    if (position[v] >= lo && position[v] < hi && seen[v] != stamp)
+                    {
+                        seen[v] = stamp;
+                        queue[tail++] = v;
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+// Reorders perm[lo, hi) into BFS order from a far-away vertex, so that
+// splitting the range in half gives two compact cells.
+void bisectRange(struct CSRGraph *forward, struct CSRGraph *backward, int *perm, int *position,
+                 int *seen, int *queue, int *stamp, int lo, int hi)
+{
+    traverseRange(forward, backward, perm, position, seen, queue, ++(*stamp), lo, hi, perm[lo]);
+    traverseRange(forward, backward, perm, position, seen, queue, ++(*stamp), lo, hi, queue[hi - lo - 1]);
+    for (int k = lo; k < hi; k++)
+    {
+        perm[k] = queue[k - lo];
+        position[perm[k]] = k;
+    }
+}
+
+
+void findCellBoundary(struct CSRGraph *csr, struct OverlayLevel *cells, int V)
+{
+    cells->entryIndex = (int *)malloc(V * sizeof(int));
+    cells->exitIndex = (int *)malloc(V * sizeof(int));
+    cells->entryOffsets = (int *)calloc(cells->cellCount + 1, sizeof(int));
+    cells->exitOffsets = (int *)calloc(cells->cellCount + 1, sizeof(int));
+    if (!cells->entryIndex || !cells->exitIndex || !cells->entryOffsets || !cells->exitOffsets)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    for (int v = 0; v < V; v++)
+    {
+        cells->entryIndex[v] = -1;
+        cells->exitIndex[v] = -1;
+    }
+    for (int u = 0; u < V; u++)
+    {
+        for (int k = csr->offsets[u]; k < csr->offsets[u + 1]; k++)
+        {
+            int v = csr->targets[k];
+            if (cells->cell[u] != cells->cell[v])
+            {
+                cells->exitIndex[u] = 0;
+                cells->entryIndex[v] = 0;
+            }
+        }
+    }
+
+    // Number entries and exits within their cells, then lay out the lists.
+    for (int v = 0; v < V; v++)
+    {
+        int c = cells->cell[v];
+        if (cells->entryIndex[v] == 0)
+        {
+            cells->entryIndex[v] = cells->entryOffsets[c + 1]++;
+        }
+        if (cells->exitIndex[v] == 0)
+        {
+            cells->exitIndex[v] = cells->exitOffsets[c + 1]++;
+        }
+    }
+    cells->matrixOffsets = (long long *)malloc((cells->cellCount + 1) * sizeof(long long));
+    if (!cells->matrixOffsets)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    cells->matrixOffsets[0] = 0;
+    for (int c = 0; c < cells->cellCount; c++)
+    {
+        cells->matrixOffsets[c + 1] = cells->matrixOffsets[c] +
+            (long long)cells->entryOffsets[c + 1] * cells->exitOffsets[c + 1];
+        cells->entryOffsets[c + 1] += cells->entryOffsets[c];
+        cells->exitOffsets[c + 1] += cells->exitOffsets[c];
+    }
+    cells->entries = (int *)malloc((cells->entryOffsets[cells->cellCount] + 1) * sizeof(int));
+    cells->exits = (int *)malloc((cells->exitOffsets[cells->cellCount] + 1) * sizeof(int));
+    cells->weights = (int *)malloc((cells->matrixOffsets[cells->cellCount] + 1) * sizeof(int));
+    cells->dirty = (bool *)malloc(cells->cellCount + 1);
+    if (!cells->entries || !cells->exits || !cells->weights || !cells->dirty)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    for (int v = 0; v < V; v++)
+    {
+        int c = cells->cell[v];
+        if (cells->entryIndex[v] >= 0)
+        {
+            cells->entries[cells->entryOffsets[c] + cells->entryIndex[v]] = v;
+        }
+        if (cells->exitIndex[v] >= 0)
+        {
+            cells->exits[cells->exitOffsets[c] + cells->exitIndex[v]] = v;
+        }
+    }
+    for (int c = 0; c < cells->cellCount; c++)
+    {
+        cells->dirty[c] = true;
+    }
+}
+
+
+struct Overlay *buildOverlay(struct Graph *graph, int cellSize)
+{
+    int V = graph->V;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    struct Overlay *overlay = (struct Overlay *)malloc(sizeof(struct Overlay));
+    if (!overlay)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    overlay->forward = buildCSR(graph, false);
+    struct CSRGraph *backward = buildCSR(graph, true);
+    for (int k = 0; k < overlay->forward->E; k++)
+    {
+        if (overlay->forward->weights[k] < 0)
+        {
+            printf("The overlay needs non-negative distances.\n");
+            freeCSR(overlay->forward);
+            freeCSR(backward);
+            free(overlay);
+            return NULL;
+        }
+    }
+
+    // Cell sizes grow 16x per level until one cell would cover the map.
+    int sizes[8];
+    overlay->levels = 0;
+    for (long long size = cellSize; overlay->levels < 8 && (overlay->levels == 0 || size < V); size *= 16)
+    {
+        sizes[overlay->levels++] = (int)size;
+    }
+    overlay->level = (struct OverlayLevel *)calloc(overlay->levels, sizeof(struct OverlayLevel));
+    int *perm = (int *)malloc((V + 1) * sizeof(int));
+    int *position = (int *)malloc((V + 1) * sizeof(int));
+    int *seen = (int *)calloc(V + 1, sizeof(int));
+    int *queue = (int *)malloc((V + 1) * sizeof(int));
+    int *ranges = (int *)malloc((V + 2) * sizeof(int));
+    int *split = (int *)malloc((V + 2) * sizeof(int));
+    if (!overlay->level || !perm || !position || !seen || !queue || !ranges || !split)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    for (int v = 0; v < V; v++)
+    {
+        perm[v] = v;
+        position[v] = v;
+    }
+
+    // Cells are contiguous ranges of perm, so splitting a coarse cell further
+    // keeps the levels nested.
+    int stamp = 0;
+    int rangeCount = 1;
+    ranges[0] = 0;
+    ranges[1] = V;
+    for (int level = overlay->levels - 1; level >= 0; level--)
+    {
+        int splitCount = 0;
+        split[0] = 0;
+        for (int r = 0; r < rangeCount; r++)
+        {
+            // Halve the range depth-first, emitting cells left to right.
+            int ends[64];
+            int stackTop = 0;
+            int lo = ranges[r];
+            ends[stackTop++] = ranges[r + 1];
+            while (stackTop > 0)
+            {
+                int hi = ends[stackTop - 1];
+                if (hi - lo > sizes[level])
+                {
+                    bisectRange(overlay->forward, backward, perm, position, seen, queue, &stamp, lo, hi);
+                    ends[stackTop++] = lo + (hi - lo) / 2;
+                }
+                else
+                {
+                    split[++splitCount] = hi;
+                    lo = hi;
+                    stackTop--;
+                }
+            }
+        }
+
+        struct OverlayLevel *cells = &overlay->level[level];
+        cells->cellCount = splitCount;
+        cells->cell = (int *)malloc((V + 1) * sizeof(int));
+        if (!cells->cell)
+        {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+        for (int c = 0; c < splitCount; c++)
+        {
+            for (int k = split[c]; k < split[c + 1]; k++)
+            {
+                cells->cell[perm[k]] = c;
+            }
+        }
+        memcpy(ranges, split, (splitCount + 1) * sizeof(int));
+        rangeCount = splitCount;
+    }
+
+    for (int level = 0; level < overlay->levels; level++)
+    {
+        findCellBoundary(overlay->forward, &overlay->level[level], V);
+    }
+    printf("Partitioned %d vertices into %d levels in %.3f s:\n", V, overlay->levels, elapsedSeconds(&start));
+    for (int level = 0; level < overlay->levels; level++)
+    {
+        struct OverlayLevel *cells = &overlay->level[level];
+        printf("  Level %d: %d cells, %d entries, %d exits, %lld clique distances\n", level + 1,
+               cells->cellCount, cells->entryOffsets[cells->cellCount], cells->exitOffsets[cells->cellCount],
+               cells->matrixOffsets[cells->cellCount]);
+    }
+
+    free(perm);
+    free(position);
+    free(seen);
+    free(queue);
+    free(ranges);
+    free(split);
+    freeCSR(backward);
+
+    customizeOverlay(overlay);
+    return overlay;
+}
+
+
+void freeOverlay(struct Overlay *overlay)
+{
+    if (!overlay)
+    {
+        return;
+    }
+    for (int level = 0; level < overlay->levels; level++)
+    {
+        struct OverlayLevel *cells = &overlay->level[level];
+        free(cells->cell);
+        free(cells->entryOffsets);
+        free(cells->entries);
+        free(cells->exitOffsets);
+        free(cells->exits);
+        free(cells->entryIndex);
+        free(cells->exitIndex);
+        free(cells->matrixOffsets);
+        free(cells->weights);
+        free(cells->dirty);
+    }
+    free(overlay->level);
+    freeCSR(overlay->forward);
+    free(overlay);
+}
+
+// A pass-through vertex has one way in and one way out: a single in-edge and
+// a single out-edge to different neighbours, or a two-way road with the same
+// two neighbours on both sides.
+bool passThrough(struct CSRGraph *forward, struct CSRGraph *reverse, int v)
+{
+    int out = forward->offsets[v], in = reverse->offsets[v];
+    int outDegree = forward->offsets[v + 1] - out, inDegree = reverse->offsets[v + 1] - in;
+    if (outDegree == 1 && inDegree == 1)
+    {
+        int a = reverse->targets[in], b = forward->targets[out];
+        return a != v && b != v && a != b;
+    }
+    if (outDegree == 2 && inDegree == 2)
+    {
+        int a = forward->targets[out], b = forward->targets[out + 1];
+        int c = reverse->targets[in], d = reverse->targets[in + 1];
+        return a != b && a != v && b != v && ((a == c && b == d) || (a == d && b == c));
+    }
+    return false;
+}
+
+
+// Largest i below count with offsets[i] <= index: the range holding index.
+int findOffset(const int *offsets, int count, int index)
+{
+    int low = 0, high = count - 1;
+    while (low < high)
+    {
+        int mid = low + (high - low + 1) / 2;
+        if (offsets[mid] <= index)
+        {
+            low = mid;
+        }
+        else
+        {
+            high = mid - 1;
+        }
+    }
+    return low;
+}
+
+
+struct ChainContraction *contractChains(struct Graph *graph)
+{
+    struct CSRGraph *forward = graph->range->forward, *reverse = graph->range->reverse;
+    int V = graph->V, E = forward->E;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    struct ChainContraction *chains = (struct ChainContraction *)malloc(sizeof(struct ChainContraction));
+    struct CSRGraph *csr = (struct CSRGraph *)malloc(sizeof(struct CSRGraph));
+    if (!chains || !csr)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    chains->graph = csr;
+    chains->reduced = (int *)malloc(V * sizeof(int));
+    chains->original = (int *)malloc((V + 1) * sizeof(int));
+    chains->place = (int *)malloc(2 * V * sizeof(int));
+    chains->stepOffsets = (int *)malloc((E + 1) * sizeof(int));
+    chains->stepVertex = (int *)malloc((E + 1) * sizeof(int));
+    chains->stepDistance = (int *)malloc((E + 1) * sizeof(int));
+    chains->stepDirection = (unsigned char *)malloc(E + 1);
+    csr->offsets = (int *)malloc((V + 1) * sizeof(int));
+    csr->targets = (int *)malloc((E + 1) * sizeof(int));
+    csr->weights = (int *)malloc((E + 1) * sizeof(int));
+    csr->directions = (unsigned char *)malloc(E + 1);
+    if (!chains->reduced || !chains->original || !chains->place || !chains->stepOffsets || !chains->stepVertex ||
+        !chains->stepDistance || !chains->stepDirection || !csr->offsets || !csr->targets || !csr->weights ||
+        !csr->directions)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+
+    int kept = 0;
+    for (int v = 0; v < V; v++)
+    {
+        chains->place[2 * v] = chains->place[2 * v + 1] = -1;
+        chains->reduced[v] = passThrough(forward, reverse, v) ? -1 : kept;
+        if (chains->reduced[v] != -1)
+        {
+            chains->original[kept++] = v;
+        }
+    }
+
+    // Each out-edge of a kept vertex starts one chain, followed through
+    // pass-through vertices to the next kept one. A ring made only of
+    // pass-through vertices is cut at its first vertex no chain reached.
+    int edges = 0, steps = 0;
+    chains->stepOffsets[0] = 0;
+    for (int r = 0, scan = 0;; r++)
+    {
+        while (r == kept && scan < V)
+        {
+            if (chains->reduced[scan] == -1 && chains->place[2 * scan] == -1)
+            {
+                chains->reduced[scan] = kept;
+                chains->original[kept++] = scan;
+            }
+            scan++;
+        }
+        if (r == kept)
+        {
+            break;
+        }
+        int u = chains->original[r];
+        csr->offsets[r] = edges;
+        for (int k = forward->offsets[u]; k < forward->offsets[u + 1]; k++)
+        {
+            int previous = u, x = forward->targets[k], e = k;
+            long long total = 0;
+            while (true)
+            {
+                chains->stepVertex[steps] = x;
+                chains->stepDistance[steps] = forward->weights[e];
+                chains->stepDirection[steps] = forward->directions[e];
+                total += forward->weights[e];
+                if (chains->reduced[x] != -1)
+                {
+                    steps++;
+                    break;
+                }
+                chains->place[2 * x + (chains->place[2 * x] != -1)] = steps++;
+                e = forward->offsets[x];
+                if (forward->targets[e] == previous && forward->offsets[x + 1] - e == 2)
+                {
+                    e++;
+                }
+                previous = x;
+                x = forward->targets[e];
+            }
+            // A chain too long for an int distance is kept as an edge no
+            // search can relax, like any other sum that reaches INT_MAX.
+            csr->targets[edges] = chains->reduced[x];
+            csr->weights[edges] = total < INT_MAX ? (int)total : INT_MAX;
+            csr->directions[edges] = forward->directions[k];
+            chains->stepOffsets[++edges] = steps;
+        }
+    }
+    csr->V = kept;
+    csr->E = edges;
+    csr->offsets[kept] = edges;
+
+    int *original = (int *)realloc(chains->original, (kept + 1) * sizeof(int));
+    int *stepOffsets = (int *)realloc(chains->stepOffsets, (edges + 1) * sizeof(int));
+    int *targets = (int *)realloc(csr->targets, (edges + 1) * sizeof(int));
+    int *weights = (int *)realloc(csr->weights, (edges + 1) * sizeof(int));
+    int *offsets = (int *)realloc(csr->offsets, (kept + 1) * sizeof(int));
+    unsigned char *directions = (unsigned char *)realloc(csr->directions, edges + 1);
+    if (!original || !stepOffsets || !targets || !weights || !offsets || !directions)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    chains->original = original;
+    chains->stepOffsets = stepOffsets;
+    csr->targets = targets;
+    csr->weights = weights;
+    csr->offsets = offsets;
+    csr->directions = directions;
+
+    printf("Contracted %d pass-through vertices in %.3f ms: %d -> %d vertices (%.1f%% fewer), %d -> %d edges "
+           "(%.1f%% fewer).\n", V - kept, elapsedSeconds(&start) * 1e3, V, kept,
+           V ? 100.0 * (V - kept) / V : 0.0, E, edges, E ? 100.0 * (E - edges) / E : 0.0);
+    return chains;
+}
+
+
+void freeChainContraction(struct ChainContraction *chains)
+{
+    if (chains)
+    {
+        free(chains->reduced);
+        free(chains->original);
+        freeCSR(chains->graph);
+        free(chains->stepOffsets);
+        free(chains->stepVertex);
+        free(chains->stepDistance);
+        free(chains->stepDirection);
+        free(chains->place);
+        free(chains);
+    }
+}
+
+
+// Distance along one chain from the vertex reached by step from to the
+// vertex reached by step to, or INT_MAX if it does not fit an int.
+int chainSpan(struct ChainContraction *chains, int from, int to)
+{
+    long long total = 0;
+    for (int p = from + 1; p <= to; p++)
+    {
+        total += chains->stepDistance[p];
+    }
+    return total < INT_MAX ? (int)total : INT_MAX;
+}
+
+
+// Appends steps from..to to the path, recording the direction taken out of
+// the vertex each one leaves.
+int appendChainSteps(struct ChainContraction *chains, int from, int to, int path[], enum Direction directions[],
+                     int length)
+{
+    for (int p = from; p <= to; p++)
+    {
+        directions[length - 1] = (enum Direction)chains->stepDirection[p];
+        path[length++] = chains->stepVertex[p];
+    }
+    return length;
+}
+
+
+// Dijkstra on the reduced graph. A source inside a chain starts at the
+// chain ends it can reach; a destination inside a chain is reached from the
+// kept vertex each of its chains starts at, or directly along a shared chain.
+void chainShortestPath(struct Graph *graph, int src, int dest)
+{
+    struct ChainContraction *chains = graph->chains;
+    struct CSRGraph *csr = chains->graph;
+    int s = toInternal(graph, src), t = toInternal(graph, dest);
+    if (!mayReach(graph, s, t))
+    {
+        printf("No route from node %lld to node %lld.\n", mapId(graph, src), mapId(graph, dest));
+        return;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int n = csr->V, E = csr->E;
+    int *distance = (int *)malloc(n * sizeof(int));
+    int *parent = (int *)malloc(n * sizeof(int));
+    int *parentEdge = (int *)malloc(n * sizeof(int));
+    struct MinHeap *heap = createMinHeap(64);
+    if (!distance || !parent || !parentEdge)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    for (int r = 0; r < n; r++)
+    {
+        distance[r] = INT_MAX;
+    }
+
+    int best = s == t ? 0 : INT_MAX, last = -1, exitStep = -1, directStep = -1;
+    int *sourcePlace = &chains->place[2 * s], *targetPlace = &chains->place[2 * t];
+    int tail[2] = {-1, -1}, prefix[2] = {0, 0};
+    if (chains->reduced[s] != -1)
+    {
+        int r = chains->reduced[s];
+        distance[r] = 0;
+        parent[r] = -1;
+        parentEdge[r] = -1;
+        heapPush(heap, 0, r);
+    }
+    for (int i = 0; i < 2 && chains->reduced[s] == -1 && sourcePlace[i] != -1; i++)
+    {
+        int e = findOffset(chains->stepOffsets, E, sourcePlace[i]);
+        int r = csr->targets[e], d = chainSpan(chains, sourcePlace[i], chains->stepOffsets[e + 1] - 1);
+        if (d < distance[r])
+        {
+            distance[r] = d;
+            parent[r] = -1;
+            parentEdge[r] = e;
+            heapPush(heap, d, r);
+        }
+        for (int j = 0; j < 2 && chains->reduced[t] == -1 && targetPlace[j] != -1; j++)
+        {
+            if (targetPlace[j] > sourcePlace[i] && targetPlace[j] < chains->stepOffsets[e + 1] &&
+                chainSpan(chains, sourcePlace[i], targetPlace[j]) < best)
+            {
+                best = chainSpan(chains, sourcePlace[i], targetPlace[j]);
+                directStep = sourcePlace[i];
+                exitStep = targetPlace[j];
+            }
+        }
+    }
+    for (int j = 0; j < 2 && chains->reduced[t] == -1 && targetPlace[j] != -1; j++)
+    {
+        int e = findOffset(chains->stepOffsets, E, targetPlace[j]);
+        tail[j] = findOffset(csr->offsets, n, e);
+        prefix[j] = chainSpan(chains, chains->stepOffsets[e] - 1, targetPlace[j]);
+    }
+
+    int settled = 0;
+    while (heap->size > 0)
+    {
+        struct HeapEntry entry = heapPop(heap);
+        int u = entry.vertex;
+        if (entry.key > distance[u])
+        {
+            continue;
+        }
+        if (entry.key >= best)
+        {
+            break;
+        }
+        settled++;
+        if (u == chains->reduced[t])
+        {
+            best = entry.key;
+            last = u;
+            exitStep = directStep = -1;
+            break;
+        }
+        for (int j = 0; j < 2; j++)
+        {
+            if (u == tail[j] && (long long)entry.key + prefix[j] < best)
+            {
+                best = entry.key + prefix[j];
+                last = u;
+                exitStep = targetPlace[j];
+                directStep = -1;
+            }
+        }
+        for (int k = csr->offsets[u]; k < csr->offsets[u + 1]; k++)
+        {
+            int v = csr->targets[k];
+            long long candidate = (long long)entry.key + csr->weights[k];
+            if (candidate < distance[v])
+            {
+                distance[v] = (int)candidate;
+                parent[v] = u;
+                parentEdge[v] = k;
+                heapPush(heap, distance[v], v);
+            }
+        }
+    }
+    double millis = elapsedSeconds(&start) * 1e3;
+    freeMinHeap(heap);
+
+    if (best == INT_MAX)
+    {
+        printf("No route from node %lld to node %lld.\n", mapId(graph, src), mapId(graph, dest));
+        free(distance);
+        free(parent);
+        free(parentEdge);
+        return;
+    }
+    printf("Distance from %lld to %lld: %d (%d of %d reduced vertices settled, %.3f ms)\n", mapId(graph, src),
+           mapId(graph, dest), best, settled, n, millis);
+
+    // Reduced edges are collected backwards, then every one is expanded into
+    // the original vertices and directions it stands for.
+    int *route = (int *)malloc((n + 1) * sizeof(int));
+    int *path = (int *)malloc((graph->V + 1) * sizeof(int));
+    enum Direction *directions = (enum Direction *)malloc((graph->V + 1) * sizeof(enum Direction));
+    if (!route || !path || !directions)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    int hops = 0, first = -1;
+    for (int r = last; r != -1; r = parent[r])
+    {
+        if (parent[r] == -1)
+        {
+            first = parentEdge[r];
+        }
+        else
+        {
+            route[hops++] = parentEdge[r];
+        }
+    }
+
+    int length = 0;
+    path[length++] = s;
+    if (directStep != -1)
+    {
+        length = appendChainSteps(chains, directStep + 1, exitStep, path, directions, length);
+    }
+    else
+    {
+        if (first != -1)
+        {
+            int from = findOffset(chains->stepOffsets, E, sourcePlace[0]) == first ? sourcePlace[0] : sourcePlace[1];
+            length = appendChainSteps(chains, from + 1, chains->stepOffsets[first + 1] - 1, path, directions, length);
+        }
+        for (int h = hops - 1; h >= 0; h--)
+        {
+            length = appendChainSteps(chains, chains->stepOffsets[route[h]], chains->stepOffsets[route[h] + 1] - 1,
+                                      path, directions, length);
+        }
+        if (exitStep != -1)
+        {
+            int e = findOffset(chains->stepOffsets, E, exitStep);
+            length = appendChainSteps(chains, chains->stepOffsets[e], exitStep, path, directions, length);
+        }
+    }
+
+    printf("Path: ");
+    for (int i = 0; i < length; i++)
+    {
+        printf("%lld", vertexId(graph, path[i]));
+        if (i < length - 1)
+        {
+            printf(" (%s) -> ", directionName(directions[i]));
+        }
+    }
+    printf("\n");
+
+    free(route);
+    free(path);
+    free(directions);
+    free(distance);
+    free(parent);
+    free(parentEdge);
+}
+
+
+// Sets every src -> dest edge to the new distance and marks the cells whose
+// cliques depend on it. Returns false when there is no such edge.
+bool updateEdgeDistance(struct Graph *graph, int src, int dest, int distance)
+{
+    bool found = false;
+    for (struct Node *temp = *adjacencySlot(graph->adjList, src); temp; temp = temp->next)
+    {
+        if (temp->data == dest)
+        {
+            temp->distance = distance;
+            found = true;
+        }
+    }
+
+    struct Overlay *overlay = graph->overlay;
+    if (found && overlay)
+    {
+        struct CSRGraph *csr = overlay->forward;
+        for (int k = csr->offsets[src]; k < csr->offsets[src + 1]; k++)
+        {
+            if (csr->targets[k] == dest)
+            {
+                csr->weights[k] = distance;
+            }
+        }
+        for (int level = 0; level < overlay->levels; level++)
+        {
+            struct OverlayLevel *cells = &overlay->level[level];
+            if (cells->cell[src] == cells->cell[dest])
+            {
+                cells->dirty[cells->cell[src]] = true;
+            }
+        }
+    }
+    return found;
+}
+
+
+void applyDistanceUpdates(struct Graph *graph, const char *filename)
+{
+    if (!graph->adjList)
+    {
+        printf("Distance updates need the uncompressed adjacency lists.\n");
+        return;
+    }
+    FILE *file = fopen(filename, "r");
+    if (!file)
+    {
+        perror("Failed to open the file for reading");
+        return;
+    }
+
+    long long srcId, destId;
+    int distance, applied = 0, skipped = 0;
+    while (fscanf(file, "%lld %lld %d", &srcId, &destId, &distance) == 3)
+    {
+        int src = denseId(graph, srcId), dest = denseId(graph, destId);
+        if (src != -1 && dest != -1 && distance >= 0 &&
+            updateEdgeDistance(graph, toInternal(graph, src), toInternal(graph, dest), distance))
+        {
+            applied++;
+        }
+        else
+        {
+            skipped++;
+        }
+    }
+    fclose(file);
+    printf("Applied %d distance updates (%d skipped).\n", applied, skipped);
+
+    if (applied > 0 && graph->hubLabels)
+    {
+        freeHubLabels(graph->hubLabels);
+        graph->hubLabels = NULL;
+        printf("Hub labels no longer match the distances and were unloaded.\n");
+    }
+    if (applied > 0 && graph->overlay)
+    {
+        customizeOverlay(graph->overlay);
+    }
+    if (applied > 0 && graph->chains)
+    {
+        freeChainContraction(graph->chains);
+        graph->chains = NULL;
+        printf("The chain contraction no longer matches the distances and was dropped.\n");
+    }
+    if (applied > 0)
+    {
+        freeRangeIndex(graph->range);
+        graph->range = NULL;
+        freeNearestPoiIndex(graph->pois);
+    }
+}
+
+
+// Highest level on which v lies in neither the source's nor the target's
+// cell, or -1 when v shares a level-0 cell with one of them.
+int queryLevel(struct Overlay *overlay, int v, int src, int dest)
+{
+    for (int level = overlay->levels - 1; level >= 0; level--)
+    {
+        int *cell = overlay->level[level].cell;
+        if (cell[v] != cell[src] && cell[v] != cell[dest])
+        {
+            return level;
+        }
+    }
+    return -1;
+}
+
+
+// Expands a clique arc into original edges by repeating the cell search
+// that produced it, recursing into the subcell cliques it used.
+int unpackCliqueArc(struct Overlay *overlay, struct OverlayWorkspace *workspace, int level, int from, int to,
+                    int path[], int length)
+{
+    cellSearch(overlay, workspace, level, from);
+    int hops = 0;
+    for (int v = to; v != from; v = workspace->parent[v])
+    {
+        hops++;
+    }
+    int *links = (int *)malloc(2 * (hops + 1) * sizeof(int));
+    if (!links)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    int k = hops;
+    for (int v = to; v != from; v = workspace->parent[v])
+    {
+        k--;
+        links[2 * k] = v;
+        links[2 * k + 1] = workspace->parentLevel[v];
+    }
+    resetOverlayWorkspace(workspace);
+
+    int previous = from;
+    for (k = 0; k < hops; k++)
+    {
+        if (links[2 * k + 1] < 0)
+        {
+            path[length++] = links[2 * k];
+        }
+        else
+        {
+            length = unpackCliqueArc(overlay, workspace, links[2 * k + 1], previous, links[2 * k], path, length);
+        }
+        previous = links[2 * k];
+    }
+    free(links);
+    return length;
+}
+
+
+void overlayShortestPath(struct Graph *graph, int src, int dest)
+{
+    struct Overlay *overlay = graph->overlay;
+    struct CSRGraph *csr = overlay->forward;
+    int s = toInternal(graph, src), t = toInternal(graph, dest);
+    struct OverlayWorkspace *workspace = createOverlayWorkspace(graph->V);
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    relaxOverlay(workspace, s, 0, -1, -1);
+    int settled = 0;
+    while (workspace->heap->size > 0)
+    {
+        struct HeapEntry entry = heapPop(workspace->heap);
+        int u = entry.vertex;
+        if (entry.key > workspace->distance[u])
+        {
+            continue;
+        }
+        settled++;
+        if (u == t)
+        {
+            break;
+        }
+
+        int level = queryLevel(overlay, u, s, t);
+        if (level >= 0 && overlay->level[level].entryIndex[u] >= 0)
+        {
+            relaxClique(overlay, workspace, level, u, entry.key);
+        }
+        int *cell = level >= 0 ? overlay->level[level].cell : NULL;
+        for (int k = csr->offsets[u]; k < csr->offsets[u + 1]; k++)
+        {
+            int v = csr->targets[k];
+            if (level < 0 || cell[v] != cell[u])
+            {
+                relaxOverlay(workspace, v, (long long)entry.key + csr->weights[k], u, -1);
+            }
+        }
+    }
+    double millis = elapsedSeconds(&start) * 1e3;
+
+    if (workspace->distance[t] == INT_MAX)
+    {
+        printf("No route from node %lld to node %lld.\n", mapId(graph, src), mapId(graph, dest));
+        freeOverlayWorkspace(workspace);
+        return;
+    }
+    printf("Distance from %lld to %lld: %d (%d vertices settled, %.3f ms)\n", mapId(graph, src), mapId(graph, dest),
+           workspace->distance[t], settled, millis);
+
+    int hops = 0;
+    for (int v = t; v != s; v = workspace->parent[v])
+    {
+        hops++;
+    }
+    int *links = (int *)malloc(2 * (hops + 1) * sizeof(int));
+    int *path = (int *)malloc((graph->V + 1) * sizeof(int));
+    if (!links || !path)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    int k = hops;
+    for (int v = t; v != s; v = workspace->parent[v])
+    {
+        k--;
+        links[2 * k] = v;
+        links[2 * k + 1] = workspace->parentLevel[v];
+    }
+    resetOverlayWorkspace(workspace);
+
+    int length = 0, previous = s;
+    path[length++] = s;
+    for (k = 0; k < hops; k++)
+    {
+        if (links[2 * k + 1] < 0)
+        {
+            path[length++] = links[2 * k];
+        }
+        else
+        {
+            length = unpackCliqueArc(overlay, workspace, links[2 * k + 1], previous, links[2 * k], path, length);
+        }
+        previous = links[2 * k];
+    }
+
+    printf("Path: ");
+    for (int i = 0; i < length; i++)
+    {
+        printf("%lld", vertexId(graph, path[i]));
+        if (i < length - 1)
+        {
+            int edgeDistance;
+            enum Direction direction;
+            if (findShortestEdge(graph, path[i], path[i + 1], &edgeDistance, &direction))
+            {
+                printf(" (%s)", directionName(direction));
+            }
+            printf(" -> ");
+        }
+    }
+    printf("\n");
+
+    free(links);
+    free(path);
+    freeOverlayWorkspace(workspace);
+}
+
+
+// Travel-time profiles are periodic piecewise-linear functions over a day,
+// given as (minute, travel time) breakpoints. Identical profiles share one
+// entry in the pool; an edge only stores the pool index in struct Node.
+struct ProfilePool *createProfilePool(void)
+{
+    struct ProfilePool *pool = (struct ProfilePool *)calloc(1, sizeof(struct ProfilePool));
+    if (!pool)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    pool->capacity = 16;
+    pool->pointCapacity = 64;
+    pool->bucketCount = 64;
+    pool->offsets = (int *)malloc((pool->capacity + 1) * sizeof(int));
+    pool->times = (int *)malloc(pool->pointCapacity * sizeof(int));
+    pool->values = (int *)malloc(pool->pointCapacity * sizeof(int));
+    pool->buckets = (int *)malloc(pool->bucketCount * sizeof(int));
+    if (!pool->offsets || !pool->times || !pool->values || !pool->buckets)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    pool->offsets[0] = 0;
+    for (int b = 0; b < pool->bucketCount; b++)
+    {
+        pool->buckets[b] = -1;
+    }
+    return pool;
+}
+
+
+void freeProfilePool(struct ProfilePool *pool)
+{
+    if (pool)
+    {
+        free(pool->offsets);
+        free(pool->times);
+        free(pool->values);
+        free(pool->buckets);
+        free(pool);
+    }
+}
+
+
+unsigned int hashProfile(const int times[], const int values[], int count)
+{
+    unsigned int hash = 2166136261u;
+    for (int i = 0; i < count; i++)
+    {
+        hash = (hash ^ (unsigned int)times[i]) * 16777619u;
+        hash = (hash ^ (unsigned int)values[i]) * 16777619u;
+    }
+    return hash;
+}
+
+
+bool sameProfile(struct ProfilePool *pool, int profile, const int times[], const int values[], int count)
+{
+    int first = pool->offsets[profile];
+    if (pool->offsets[profile + 1] - first != count)
+    {
+        return false;
+    }
+    return memcmp(pool->times + first, times, count * sizeof(int)) == 0 &&
+           memcmp(pool->values + first, values, count * sizeof(int)) == 0;
+}
+
+
+// Breakpoints must be strictly increasing minutes within the period, and no
+// segment (including the wrap to the next day) may fall faster than time
+// passes, so leaving later never means arriving earlier (FIFO).
+bool validProfile(const int times[], const int values[], int count)
+{
+    if (count < 1)
+    {
+        return false;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        if (times[i] < 0 || times[i] >= PROFILE_PERIOD || values[i] < 0 || (i > 0 && times[i] <= times[i - 1]))
+        {
+            return false;
+        }
+        int next = (i + 1) % count;
+        int span = next > i ? times[next] - times[i] : times[next] + PROFILE_PERIOD - times[i];
+        if (count > 1 && values[next] - values[i] < -span)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+int internProfile(struct ProfilePool *pool, const int times[], const int values[], int count)
+{
+    unsigned int hash = hashProfile(times, values, count);
+    int bucket = (int)(hash & (unsigned int)(pool->bucketCount - 1));
+    while (pool->buckets[bucket] != -1)
+    {
+        if (sameProfile(pool, pool->buckets[bucket], times, values, count))
+        {
+            return pool->buckets[bucket];
+        }
+        bucket = (bucket + 1) & (pool->bucketCount - 1);
+    }
+
+    if (pool->count == pool->capacity)
+    {
+        pool->capacity *= 2;
+        pool->offsets = (int *)realloc(pool->offsets, (pool->capacity + 1) * sizeof(int));
+        if (!pool->offsets)
+        {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    while (pool->offsets[pool->count] + count > pool->pointCapacity)
+    {
+        pool->pointCapacity *= 2;
+        pool->times = (int *)realloc(pool->times, pool->pointCapacity * sizeof(int));
+        pool->values = (int *)realloc(pool->values, pool->pointCapacity * sizeof(int));
+        if (!pool->times || !pool->values)
+        {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    int profile = pool->count++;
+    int first = pool->offsets[profile];
+    memcpy(pool->times + first, times, count * sizeof(int));
+    memcpy(pool->values + first, values, count * sizeof(int));
+    pool->offsets[profile + 1] = first + count;
+    pool->buckets[bucket] = profile;
+
+    if (pool->count * 2 > pool->bucketCount)
+    {
+        pool->bucketCount *= 2;
+        pool->buckets = (int *)realloc(pool->buckets, pool->bucketCount * sizeof(int));
+        if (!pool->buckets)
+        {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+        for (int b = 0; b < pool->bucketCount; b++)
+        {
+            pool->buckets[b] = -1;
+        }
+        for (int p = 0; p < pool->count; p++)
+        {
+            int at = pool->offsets[p];
+            unsigned int h = hashProfile(pool->times + at, pool->values + at, pool->offsets[p + 1] - at);
+            int b = (int)(h & (unsigned int)(pool->bucketCount - 1));
+            while (pool->buckets[b] != -1)
+            {
+                b = (b + 1) & (pool->bucketCount - 1);
+            }
+            pool->buckets[b] = p;
+        }
+    }
+    return profile;
+}
+
+
+// Travel time when entering the edge at the given minute (any day).
+int evaluateProfile(struct ProfilePool *pool, int profile, long long when)
+{
+    int first = pool->offsets[profile];
+    int count = pool->offsets[profile + 1] - first;
+    const int *times = pool->times + first;
+    const int *values = pool->values + first;
+    int tau = (int)(when % PROFILE_PERIOD);
+    if (count == 1)
+    {
+        return values[0];
+    }
+
+    int lo = 0, hi = count - 1;
+    if (tau < times[0])
+    {
+        tau += PROFILE_PERIOD;
+        lo = count - 1;
+    }
+    else
+    {
+        while (lo < hi)
+        {
+            int mid = (lo + hi + 1) / 2;
+            if (times[mid] <= tau)
+            {
+                lo = mid;
+            }
+            else
+            {
+                hi = mid - 1;
+            }
+        }
+    }
+    int next = lo + 1 < count ? lo + 1 : 0;
+    int nextTime = next > lo ? times[next] : times[next] + PROFILE_PERIOD;
+    return values[lo] + (int)((long long)(values[next] - values[lo]) * (tau - times[lo]) / (nextTime - times[lo]));
+}
+
+
+// Each line: "src dest minute:time minute:time ...". The profile applies to
+// every src -> dest edge.
+void loadTravelTimeProfiles(struct Graph *graph, const char *filename)
+{
+    if (!graph->adjList)
+    {
+        printf("Travel-time profiles need the uncompressed adjacency lists.\n");
+        return;
+    }
+    FILE *file = fopen(filename, "r");
+    if (!file)
+    {
+        perror("Failed to open the file for reading");
+        return;
+    }
+    if (!graph->profiles)
+    {
+        graph->profiles = createProfilePool();
+    }
+
+    char line[4096];
+    int times[256], values[256];
+    long lineNumber = 0;
+    int assigned = 0, skipped = 0;
+    while (fgets(line, sizeof(line), file))
+    {
+        lineNumber++;
+        long long srcId, destId;
+        int consumed;
+        if (sscanf(line, "%lld %lld%n", &srcId, &destId, &consumed) != 2)
+        {
+            continue;
+        }
+        int src = denseId(graph, srcId), dest = denseId(graph, destId);
+
+        int count = 0, used;
+        char *pos = line + consumed;
+        while (count < 256 && sscanf(pos, " %d:%d%n", &times[count], &values[count], &used) == 2)
+        {
+            pos += used;
+            count++;
+        }
+        if (src == -1 || dest == -1 || !validProfile(times, values, count))
+        {
+            printf("Line %ld: invalid profile, skipped.\n", lineNumber);
+            skipped++;
+            continue;
+        }
+
+        int profile = internProfile(graph->profiles, times, values, count);
+        bool found = false;
+        for (struct Node *temp = *adjacencySlot(graph->adjList, toInternal(graph, src)); temp; temp = temp->next)
+        {
+            if (temp->data == toInternal(graph, dest))
+            {
+                temp->profile = profile;
+                found = true;
+            }
+        }
+        if (found)
+        {
+            assigned++;
+        }
+        else
+        {
+            printf("Line %ld: no edge from %lld to %lld, skipped.\n", lineNumber, srcId, destId);
+            skipped++;
+        }
+    }
+    fclose(file);
+    printf("Assigned %d profiles (%d skipped); the pool holds %d distinct profiles with %d breakpoints.\n",
+           assigned, skipped, graph->profiles->count, graph->profiles->offsets[graph->profiles->count]);
+}
+
+
+// Label-setting Dijkstra on arrival times: with FIFO profiles the earliest
+// arrival at a vertex is also the best time to continue from it.
+void timeDependentDijkstra(struct Graph *graph, int src, int dest, int departure)
+{
+    int V = graph->V;
+    long long *arrival = (long long *)malloc(V * sizeof(long long));
+    int *parent = (int *)malloc(V * sizeof(int));
+    struct MinHeap *heap = createMinHeap(64);
+    if (!arrival || !parent)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    for (int v = 0; v < V; v++)
+    {
+        arrival[v] = LLONG_MAX;
+        parent[v] = -1;
+    }
+
+    int s = toInternal(graph, src), t = toInternal(graph, dest);
+    arrival[s] = departure;
+    heapPush(heap, 0, s);
+    while (heap->size > 0)
+    {
+        struct HeapEntry entry = heapPop(heap);
+        int u = entry.vertex;
+        if (departure + (long long)entry.key > arrival[u])
+        {
+            continue;
+        }
+        if (u == t)
+        {
+            break;
+        }
+        for (struct Node *temp = *adjacencySlot(graph->adjList, u); temp; temp = temp->next)
+        {
+            int cost = temp->profile >= 0 ? evaluateProfile(graph->profiles, temp->profile, arrival[u])
+                                          : temp->distance;
+            long long reached = arrival[u] + cost;
+            if (reached < arrival[temp->data] && reached - departure < INT_MAX)
+            {
+                arrival[temp->data] = reached;
+                parent[temp->data] = u;
+                heapPush(heap, (int)(reached - departure), temp->data);
+            }
+        }
+    }
+
+    if (arrival[t] == LLONG_MAX)
+    {
+        printf("No route from node %lld to node %lld.\n", mapId(graph, src), mapId(graph, dest));
+    }
+    else
+    {
+        printf("Leaving %d at minute %d, arriving at %d at minute %lld (travel time %lld)\n",
+               src, departure, dest, arrival[t], arrival[t] - departure);
+        int length = 0;
+        for (int v = t; v != -1; v = parent[v])
+        {
+            length++;
+        }
+        int *path = (int *)malloc(length * sizeof(int));
+        if (!path)
+        {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+        int k = length;
+        for (int v = t; v != -1; v = parent[v])
+        {
+            path[--k] = v;
+        }
+        printf("Path: ");
+        for (k = 0; k < length; k++)
+        {
+            printf("%lld [%lld]", vertexId(graph, path[k]), arrival[path[k]]);
+            if (k < length - 1)
+            {
+                for (struct Node *temp = *adjacencySlot(graph->adjList, path[k]); temp; temp = temp->next)
+                {
+                    int cost = temp->profile >= 0
+                                   ? evaluateProfile(graph->profiles, temp->profile, arrival[path[k]])
+                                   : temp->distance;
+                    if (temp->data == path[k + 1] && arrival[path[k]] + cost == arrival[path[k + 1]])
+                    {
+                        printf(" (%s)", directionName(temp->direction));
+                        break;
+                    }
+                }
+                printf(" -> ");
+            }
+        }
+        printf("\n");
+        free(path);
+    }
+
+    free(arrival);
+    free(parent);
+    freeMinHeap(heap);
+}
+
+
+// Settles every vertex within budget of the source (or, in reverse, every
+// vertex that reaches the source within budget) and then lists the edges
+// that leave that region, with how far along each one the budget runs out.
+void rangeQuery(struct Graph *graph, struct SearchWorkspace *workspace, int source, int budget, bool reverse)
+{
+    struct CSRGraph *csr = reverse ? graph->range->reverse : graph->range->forward;
+    int *distance = workspace->distance, *parent = workspace->parent, *settled = workspace->path;
+    int settledCount = 0;
+
+    int s = toInternal(graph, source);
+    beginSearch(workspace);
+    reachVertex(workspace, s, 0, -1);
+    heapPush(workspace->heap, 0, s);
+    while (workspace->heap->size > 0)
+    {
+        struct HeapEntry entry = heapPop(workspace->heap);
+        int u = entry.vertex;
+        if (entry.key > budget)
+        {
+            break;
+        }
+        if (entry.key > distance[u])
+        {
+            continue;
+        }
+        settled[settledCount++] = u;
+        for (int k = csr->offsets[u]; k < csr->offsets[u + 1]; k++)
+        {
+            int v = csr->targets[k];
+            long long d = (long long)distance[u] + csr->weights[k];
+            if (d <= budget && d < reachedDistance(workspace, v))
+            {
+                reachVertex(workspace, v, (int)d, u);
+                heapPush(workspace->heap, (int)d, v);
+            }
+        }
+    }
+
+    printf("%d vertices %s node %lld within %d:\n", settledCount, reverse ? "can reach" : "are reachable from",
+           mapId(graph, source), budget);
+    for (int k = 0; k < settledCount; k++)
+    {
+        int v = settled[k];
+        printf("  %lld at distance %d", vertexId(graph, v), distance[v]);
+        if (parent[v] != -1)
+        {
+            printf(" (via %lld)", vertexId(graph, parent[v]));
+        }
+        printf("\n");
+    }
+
+    int boundary = 0;
+    printf("Boundary edges:\n");
+    for (int k = 0; k < settledCount; k++)
+    {
+        int u = settled[k];
+        for (int e = csr->offsets[u]; e < csr->offsets[u + 1]; e++)
+        {
+            int v = csr->targets[e];
+            if (reachedDistance(workspace, v) == INT_MAX)
+            {
+                int from = reverse ? v : u, to = reverse ? u : v;
+                printf("  %lld -> %lld (%s), distance %d, %d of it within budget\n", vertexId(graph, from),
+                       vertexId(graph, to), directionName((enum Direction)csr->directions[e]), csr->weights[e],
+                       budget - distance[u]);
+                boundary++;
+            }
+        }
+    }
+    if (boundary == 0)
+    {
+        printf("  none\n");
+    }
+}
+
+
+int treeDistance(struct RouteTree *tree, int v)
+{
+    return tree->reached[v] == tree->generation ? tree->distance[v] : INT_MAX;
+}
+
+
+int treeParent(struct RouteTree *tree, int v)
+{
+    return tree->reached[v] == tree->generation ? tree->parent[v] : -1;
+}
+
+
+bool treeDone(struct RouteTree *tree, int v)
+{
+    return tree->done[v] == tree->generation;
+}
+
+
+// Dijkstra over a CSR that records the settle order. Once stop is settled it
+// only goes on while the queue minimum stays within stretch times its distance.
+void boundedTree(struct CSRGraph *csr, int source, int stop, double stretch, struct RouteTree *tree)
+{
+    struct MinHeap *heap = createMinHeap(64);
+    if (++tree->generation == 0)
+    {
+        memset(tree->reached, 0, tree->V * sizeof(unsigned int));
+        memset(tree->done, 0, tree->V * sizeof(unsigned int));
+        tree->generation = 1;
+    }
+    tree->settledCount = 0;
+    tree->reached[source] = tree->generation;
+    tree->distance[source] = 0;
+    tree->parent[source] = -1;
+    heapPush(heap, 0, source);
+    long long limit = LLONG_MAX;
+    while (heap->size > 0)
+    {
+        struct HeapEntry entry = heapPop(heap);
+        int u = entry.vertex;
+        if (entry.key > limit)
+        {
+            break;
+        }
+        if (treeDone(tree, u))
+        {
+            continue;
+        }
+        tree->done[u] = tree->generation;
+        tree->settled[tree->settledCount++] = u;
+        if (u == stop)
+        {
+            limit = (long long)(entry.key * stretch);
+        }
+        for (int k = csr->offsets[u]; k < csr->offsets[u + 1]; k++)
+        {
+            int v = csr->targets[k];
+            long long d = (long long)tree->distance[u] + csr->weights[k];
+            if (!treeDone(tree, v) && d < treeDistance(tree, v))
+            {
+                tree->reached[v] = tree->generation;
+                tree->distance[v] = (int)d;
+                tree->parent[v] = u;
+                tree->parentEdge[v] = k;
+                heapPush(heap, (int)d, v);
+            }
+        }
+    }
+    freeMinHeap(heap);
+}
+
+
+// Point-to-point distance on a CSR, giving up (INT_MAX) once the queue
+// minimum exceeds bound.
+int boundedDistance(struct CSRGraph *csr, struct SearchWorkspace *workspace, int source, int target, int bound)
+{
+    int *distance = workspace->distance;
+    int result = INT_MAX;
+    beginSearch(workspace);
+    reachVertex(workspace, source, 0, -1);
+    heapPush(workspace->heap, 0, source);
+    while (workspace->heap->size > 0)
+    {
+        struct HeapEntry entry = heapPop(workspace->heap);
+        int u = entry.vertex;
+        if (entry.key > bound)
+        {
+            break;
+        }
+        if (entry.key > distance[u])
+        {
+            continue;
+        }
+        if (u == target)
+        {
+            result = entry.key;
+            break;
+        }
+        for (int k = csr->offsets[u]; k < csr->offsets[u + 1]; k++)
+        {
+            int v = csr->targets[k];
+            long long d = (long long)distance[u] + csr->weights[k];
+            if (d < reachedDistance(workspace, v))
+            {
+                reachVertex(workspace, v, (int)d, u);
+                heapPush(workspace->heap, (int)d, v);
+            }
+        }
+    }
+    return result;
+}
+
+
+// Route through via: the forward tree from the source to via, then the
+// backward tree from via to the target. Returns the number of vertices, or 0
+// when the two halves meet again and the route would not be simple.
+int buildViaRoute(struct RouteTree *forward, struct RouteTree *backward, int via,
+                  int route[], int edgeIndex[], bool edgeReverse[], int mark[], int stamp)
+{
+    int length = 0;
+    for (int v = via; v != -1; v = forward->parent[v])
+    {
+        length++;
+    }
+    int k = length;
+    for (int v = via; v != -1; v = forward->parent[v])
+    {
+        k--;
+        route[k] = v;
+        mark[v] = stamp;
+        if (k > 0)
+        {
+            edgeIndex[k - 1] = forward->parentEdge[v];
+            edgeReverse[k - 1] = false;
+        }
+    }
+    for (int v = backward->parent[via]; v != -1; v = backward->parent[v])
+    {
+        if (mark[v] == stamp)
+        {
+            return 0;
+        }
+        mark[v] = stamp;
+        edgeIndex[length - 1] = backward->parentEdge[route[length - 1]];
+        edgeReverse[length - 1] = true;
+        route[length++] = v;
+    }
+    return length;
+}
+
+
+int compareViaCandidate(const void *a, const void *b)
+{
+    const struct ViaCandidate *x = (const struct ViaCandidate *)a;
+    const struct ViaCandidate *y = (const struct ViaCandidate *)b;
+    if (x->score != y->score)
+    {
+        return x->score < y->score ? -1 : 1;
+    }
+    return x->vertex - y->vertex;
+}
+
+
+void printRoute(struct Graph *graph, struct RangeIndex *range, int route[], int edgeIndex[], bool edgeReverse[],
+                int length)
+{
+    for (int k = 0; k < length; k++)
+    {
+        printf("%lld", vertexId(graph, route[k]));
+        if (k < length - 1)
+        {
+            struct CSRGraph *csr = edgeReverse[k] ? range->reverse : range->forward;
+            printf(" (%s) -> ", directionName((enum Direction)csr->directions[edgeIndex[k]]));
+        }
+    }
+    printf("\n");
+}
+
+
+// Via-node alternatives: one forward tree from the source and one backward
+// tree from the target, both bounded by the stretch limit. Every vertex v in
+// both trees gives the route source -> v -> target; candidates are ranked by
+// length, approximate sharing with the main route and the plateau through v
+// (the stretch where the two trees follow the same edges). The best ones are
+// accepted if they share little with the routes already chosen and pass a
+// local optimality test around v.
+void alternativeRoutes(struct Graph *graph, struct SearchWorkspace *workspace, int src, int dest, int count)
+{
+    struct RangeIndex *range = graph->range;
+    int V = graph->V;
+    int s = toInternal(graph, src), t = toInternal(graph, dest);
+    if (!workspace->forwardTree)
+    {
+        workspace->forwardTree = createRouteTree(V);
+        workspace->backwardTree = createRouteTree(V);
+    }
+    struct RouteTree *forward = workspace->forwardTree, *backward = workspace->backwardTree;
+    boundedTree(range->forward, s, t, 1 + ALT_STRETCH, forward);
+    if (!treeDone(forward, t) || s == t)
+    {
+        printf(s == t ? "Source and destination are the same node.\n" : "No route from node %lld to node %lld.\n",
+               mapId(graph, src), mapId(graph, dest));
+        return;
+    }
+    boundedTree(range->reverse, t, s, 1 + ALT_STRETCH, backward);
+    int D = forward->distance[t];
+
+    int *plateau = (int *)malloc(V * sizeof(int));
+    int *shared = (int *)malloc(V * sizeof(int));
+    int *plateauAfter = (int *)malloc(V * sizeof(int));
+    int *sharedAfter = (int *)malloc(V * sizeof(int));
+    bool *onMain = (bool *)malloc(V * sizeof(bool));
+    int *route = (int *)malloc(V * sizeof(int));
+    int *edgeIndex = (int *)malloc(V * sizeof(int));
+    bool *edgeReverse = (bool *)malloc(V * sizeof(bool));
+    long long *along = (long long *)malloc(V * sizeof(long long));
+    int *mark = (int *)malloc(V * sizeof(int));
+    int *nextOn = (int *)malloc((size_t)(MAX_ALTERNATIVES + 1) * V * sizeof(int));
+    struct ViaCandidate *candidates = (struct ViaCandidate *)malloc(V * sizeof(struct ViaCandidate));
+    if (!plateau || !shared || !plateauAfter || !sharedAfter || !onMain || !route || !edgeIndex || !edgeReverse ||
+        !along || !mark || !nextOn || !candidates)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    // Only vertices settled in one of the trees are ever read, so only they
+    // are reset.
+    for (int side = 0; side < 2; side++)
+    {
+        struct RouteTree *tree = side == 0 ? forward : backward;
+        for (int k = 0; k < tree->settledCount; k++)
+        {
+            int v = tree->settled[k];
+            plateau[v] = shared[v] = plateauAfter[v] = sharedAfter[v] = mark[v] = 0;
+            onMain[v] = false;
+            for (int r = 0; r <= MAX_ALTERNATIVES; r++)
+            {
+                nextOn[(size_t)r * V + v] = -1;
+            }
+        }
+    }
+    for (int v = t; v != -1; v = forward->parent[v])
+    {
+        onMain[v] = true;
+    }
+
+    // Plateau and sharing lengths before v follow the forward settle order,
+    // the parts after v the backward one.
+    for (int k = 0; k < forward->settledCount; k++)
+    {
+        int v = forward->settled[k], p = forward->parent[v];
+        if (p != -1 && treeDone(backward, v) && treeParent(backward, p) == v)
+        {
+            plateau[v] = plateau[p] + forward->distance[v] - forward->distance[p];
+        }
+        shared[v] = onMain[v] ? forward->distance[v] : (p != -1 ? shared[p] : 0);
+    }
+    for (int k = 0; k < backward->settledCount; k++)
+    {
+        int v = backward->settled[k], p = backward->parent[v];
+        if (p != -1 && treeDone(forward, v) && treeParent(forward, p) == v)
+        {
+            plateauAfter[v] = plateauAfter[p] + backward->distance[v] - backward->distance[p];
+        }
+        sharedAfter[v] = onMain[v] ? backward->distance[v] : (p != -1 ? sharedAfter[p] : 0);
+    }
+
+    int candidateCount = 0;
+    for (int k = 0; k < forward->settledCount; k++)
+    {
+        int v = forward->settled[k];
+        if (onMain[v] || !treeDone(backward, v))
+        {
+            continue;
+        }
+        long long length = (long long)forward->distance[v] + backward->distance[v];
+        if (length <= D * (1 + ALT_STRETCH))
+        {
+            candidates[candidateCount].vertex = v;
+            candidates[candidateCount].score = 2 * length + shared[v] + sharedAfter[v] - plateau[v] - plateauAfter[v];
+            candidateCount++;
+        }
+    }
+    qsort(candidates, candidateCount, sizeof(struct ViaCandidate), compareViaCandidate);
+
+    int length = buildViaRoute(forward, backward, t, route, edgeIndex, edgeReverse, mark, 1);
+    printf("Route 1 (shortest): distance %d\n", D);
+    printRoute(graph, range, route, edgeIndex, edgeReverse, length);
+    for (int k = 0; k + 1 < length; k++)
+    {
+        nextOn[route[k]] = route[k + 1];
+    }
+
+    int routes = 1, tested = 0;
+    for (int c = 0; c < candidateCount && routes <= count && tested < ALT_CANDIDATES; c++)
+    {
+        int via = candidates[c].vertex;
+        length = buildViaRoute(forward, backward, via, route, edgeIndex, edgeReverse, mark, c + 2);
+        if (length == 0)
+        {
+            continue;
+        }
+        tested++;
+
+        // Exact sharing with every route chosen so far.
+        long long sharedLength = 0;
+        int viaPosition = 0;
+        along[0] = 0;
+        for (int k = 0; k + 1 < length; k++)
+        {
+            struct CSRGraph *csr = edgeReverse[k] ? range->reverse : range->forward;
+            int weight = csr->weights[edgeIndex[k]];
+            along[k + 1] = along[k] + weight;
+            bool isShared = false;
+            for (int r = 0; r < routes && !isShared; r++)
+            {
+                isShared = nextOn[(size_t)r * V + route[k]] == route[k + 1];
+            }
+            sharedLength += isShared ? weight : 0;
+            if (route[k + 1] == via)
+            {
+                viaPosition = k + 1;
+            }
+        }
+        if (sharedLength > ALT_SHARING * D)
+        {
+            continue;
+        }
+
+        // Local optimality: the stretch of the route around via, reaching
+        // ALT_LOCAL * D to either side, must itself be a shortest path.
+        int x = viaPosition, y = viaPosition;
+        while (x > 0 && along[viaPosition] - along[x] < ALT_LOCAL * D)
+        {
+            x--;
+        }
+        while (y < length - 1 && along[y] - along[viaPosition] < ALT_LOCAL * D)
+        {
+            y++;
+        }
+        int local = (int)(along[y] - along[x]);
+        if (boundedDistance(range->forward, workspace, route[x], route[y], local) < local)
+        {
+            continue;
+        }
+
+        // A zero-length shortest route only admits other zero-length ones.
+        printf("Route %d via node %lld: distance %lld (stretch %.2f", routes + 1, vertexId(graph, via),
+               along[length - 1], D > 0 ? (double)along[length - 1] / D : 1.0);
+        if (D > 0)
+        {
+            printf(", %.0f%% shared with earlier routes", 100.0 * sharedLength / D);
+        }
+        printf(")\n");
+        printRoute(graph, range, route, edgeIndex, edgeReverse, length);
+        if (routes < MAX_ALTERNATIVES + 1)
+        {
+            int *next = nextOn + (size_t)routes * V;
+            for (int k = 0; k + 1 < length; k++)
+            {
+                next[route[k]] = route[k + 1];
+            }
+        }
+        routes++;
+    }
+    if (routes == 1)
+    {
+        printf("No alternative route within %.0f%% of the shortest distance passed the filters.\n",
+               ALT_STRETCH * 100);
+    }
+
+    free(plateau);
+    free(shared);
+    free(plateauAfter);
+    free(sharedAfter);
+    free(onMain);
+    free(route);
+    free(edgeIndex);
+    free(edgeReverse);
+    free(along);
+    free(mark);
+    free(nextOn);
+    free(candidates);
+}
+
+
+// Multi-criteria label-setting search for the Pareto front of (distance,
+// turns), where every edge that is not STRAIGHT counts as a turn. Labels are
+// settled in (distance, turns) order, so a label is dominated exactly when
+// its vertex has already settled one with no more turns: each vertex only
+// keeps the fewest turns settled there, and a new label is dropped unless it
+// beats both that and the fewest turns settled at the target so far.
+void paretoRoutes(struct Graph *graph, int src, int dest)
+{
+    int V = graph->V;
+    int s = toInternal(graph, src), t = toInternal(graph, dest);
+    if (!mayReach(graph, s, t))
+    {
+        printf("No route from node %lld to node %lld.\n", mapId(graph, src), mapId(graph, dest));
+        return;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int *fewestTurns = (int *)malloc(V * sizeof(int));
+    int count = 0, capacity = 1024, frontCount = 0, settled = 0;
+    struct ParetoLabel *labels = (struct ParetoLabel *)malloc(capacity * sizeof(struct ParetoLabel));
+    int *front = (int *)malloc(V * sizeof(int));
+    struct MinHeap *heap = createMinHeap(64);
+    if (!fewestTurns || !labels || !front)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    for (int v = 0; v < V; v++)
+    {
+        fewestTurns[v] = INT_MAX;
+    }
+
+    labels[count++] = (struct ParetoLabel){s, 0, 0, -1, STRAIGHT};
+    heapPushOrdered(heap, 0, 0, 0);
+    while (heap->size > 0)
+    {
+        int from = heapPop(heap).vertex;
+        int u = labels[from].vertex, distance = labels[from].distance, turns = labels[from].turns;
+        if (turns >= fewestTurns[u])
+        {
+            continue;
+        }
+        fewestTurns[u] = turns;
+        settled++;
+        if (u == t)
+        {
+            front[frontCount++] = from;
+            if (turns == 0)
+            {
+                break;
+            }
+            continue;
+        }
+
+        struct EdgeCursor cursor;
+        int v, w;
+        enum Direction direction;
+        firstEdge(graph, u, &cursor);
+        while (nextEdge(&cursor, &v, &w, &direction))
+        {
+            int nextTurns = turns + (direction != STRAIGHT);
+            if (nextTurns >= fewestTurns[v] || nextTurns >= fewestTurns[t] || distance > INT_MAX - w)
+            {
+                continue;
+            }
+            if (count == capacity)
+            {
+                capacity *= 2;
+                labels = (struct ParetoLabel *)realloc(labels, capacity * sizeof(struct ParetoLabel));
+                if (!labels)
+                {
+                    perror("Memory allocation failed");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            labels[count] = (struct ParetoLabel){v, distance + w, nextTurns, from, direction};
+            heapPushOrdered(heap, distance + w, nextTurns, count);
+            count++;
+        }
+    }
+    double millis = elapsedSeconds(&start) * 1000;
+
+    // mayReach can let an unreachable pair through, so the front may be empty.
+    if (frontCount == 0)
+    {
+        printf("No route from node %lld to node %lld.\n", mapId(graph, src), mapId(graph, dest));
+    }
+    else
+    {
+        printf("Pareto front from %lld to %lld: %d routes (%d labels created, %d settled, %.3f ms)\n",
+               mapId(graph, src), mapId(graph, dest), frontCount, count, settled, millis);
+    }
+    int *path = fewestTurns;
+    for (int k = 0; k < frontCount; k++)
+    {
+        int length = 0;
+        for (int l = front[k]; l != -1; l = labels[l].parent)
+        {
+            path[length++] = l;
+        }
+        printf("Distance %d, %d turns: ", labels[front[k]].distance, labels[front[k]].turns);
+        for (int i = length - 1; i >= 0; i--)
+        {
+            printf("%lld", vertexId(graph, labels[path[i]].vertex));
+            if (i > 0)
+            {
+                printf(" (%s) -> ", directionName(labels[path[i - 1]].direction));
+            }
+        }
+        printf("\n");
+    }
+
+    free(fewestTurns);
+    free(labels);
+    free(front);
+    freeMinHeap(heap);
+}
+
+
+// Dijkstra from the source that stops once k points of interest with the
+// requested tag (or any tag when tag is -1) have been settled.
+void nearestPointsOfInterest(struct Graph *graph, struct SearchWorkspace *workspace, int source, int k, int tag)
+{
+    struct PoiIndex *pois = graph->pois;
+    struct PoiIndex *index = pois->nearestK >= k && pois->nearestTag == tag ? pois : NULL;
+    int s = toInternal(graph, source);
+    int found = 0;
+
+    if (index)
+    {
+        for (int j = 0; j < k && index->nearest[(size_t)s * index->nearestK + j] != -1; j++)
+        {
+            int p = index->nearest[(size_t)s * index->nearestK + j];
+            printf("  %lld (%s) at distance %d\n", mapId(graph, pois->vertex[p]), pois->tagNames[pois->tag[p]],
+                   index->nearestDistance[(size_t)s * index->nearestK + j]);
+            found++;
+        }
+        printf("%d points of interest found from the precomputed index.\n", found);
+        return;
+    }
+
+    struct CSRGraph *csr = graph->range->forward;
+    int *distance = workspace->distance;
+    int settledCount = 0;
+
+    beginSearch(workspace);
+    reachVertex(workspace, s, 0, -1);
+    heapPush(workspace->heap, 0, s);
+    while (workspace->heap->size > 0 && found < k)
+    {
+        struct HeapEntry entry = heapPop(workspace->heap);
+        int u = entry.vertex;
+        if (entry.key > distance[u])
+        {
+            continue;
+        }
+        settledCount++;
+        for (int p = pois->first[u]; p != -1 && found < k; p = pois->next[p])
+        {
+            if (tag == -1 || pois->tag[p] == tag)
+            {
+                printf("  %lld (%s) at distance %d\n", mapId(graph, pois->vertex[p]), pois->tagNames[pois->tag[p]],
+                       distance[u]);
+                found++;
+            }
+        }
+        for (int e = csr->offsets[u]; e < csr->offsets[u + 1]; e++)
+        {
+            int v = csr->targets[e];
+            long long d = (long long)distance[u] + csr->weights[e];
+            if (d < reachedDistance(workspace, v))
+            {
+                reachVertex(workspace, v, (int)d, u);
+                heapPush(workspace->heap, (int)d, v);
+            }
+        }
+    }
+    printf("%d points of interest found after settling %d vertices.\n", found, settledCount);
+}
+
+
+int addPoiLabel(struct PoiLabels *labels, int vertex, int poi)
+{
+    if (labels->count == labels->capacity)
+    {
+        labels->capacity = labels->capacity ? labels->capacity * 2 : 1024;
+        labels->vertex = (int *)realloc(labels->vertex, labels->capacity * sizeof(int));
+        labels->poi = (int *)realloc(labels->poi, labels->capacity * sizeof(int));
+        if (!labels->vertex || !labels->poi)
+        {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    labels->vertex[labels->count] = vertex;
+    labels->poi[labels->count] = poi;
+    return labels->count++;
+}
+
+
+// Stores the K nearest points of interest of every vertex. One multi-source
+// search runs backwards from all of them at once; a label (poi, distance) is
+// kept at a vertex only while it has fewer than K labels and none for that
+// poi yet, so labels settle in distance order and each vertex keeps its K best.
+void buildNearestPoiIndex(struct Graph *graph, int K, int tag)
+{
+    struct PoiIndex *pois = graph->pois;
+    int V = graph->V;
+    struct CSRGraph *reverse = buildCSR(graph, true);
+    int *nearest = (int *)malloc((size_t)V * K * sizeof(int));
+    int *nearestDistance = (int *)malloc((size_t)V * K * sizeof(int));
+    int *labelCount = (int *)calloc(V, sizeof(int));
+    struct PoiLabels labels = {0, 0, NULL, NULL};
+    struct MinHeap *heap = createMinHeap(64);
+    if (!nearest || !nearestDistance || !labelCount)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t j = 0; j < (size_t)V * K; j++)
+    {
+        nearest[j] = -1;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int p = 0; p < pois->count; p++)
+    {
+        if (tag == -1 || pois->tag[p] == tag)
+        {
+            heapPush(heap, 0, addPoiLabel(&labels, toInternal(graph, pois->vertex[p]), p));
+        }
+    }
+    while (heap->size > 0)
+    {
+        struct HeapEntry entry = heapPop(heap);
+        int u = labels.vertex[entry.vertex];
+        int poi = labels.poi[entry.vertex];
+        size_t base = (size_t)u * K;
+        bool useful = labelCount[u] < K;
+        for (int j = 0; useful && j < labelCount[u]; j++)
+        {
+            useful = nearest[base + j] != poi;
+        }
+        if (!useful)
+        {
+            continue;
+        }
+        nearest[base + labelCount[u]] = poi;
+        nearestDistance[base + labelCount[u]] = entry.key;
+        labelCount[u]++;
+
+        for (int e = reverse->offsets[u]; e < reverse->offsets[u + 1]; e++)
+        {
+            int w = reverse->targets[e];
+            long long d = (long long)entry.key + reverse->weights[e];
+            if (labelCount[w] < K && d < INT_MAX)
+            {
+                heapPush(heap, (int)d, addPoiLabel(&labels, w, poi));
+            }
+        }
+    }
+
+    freeNearestPoiIndex(pois);
+    pois->nearest = nearest;
+    pois->nearestDistance = nearestDistance;
+    pois->nearestK = K;
+    pois->nearestTag = tag;
+    printf("Indexed the %d nearest points of interest%s%s for %d vertices in %.3f s (%d labels pushed).\n", K,
+           tag == -1 ? "" : " tagged ", tag == -1 ? "" : pois->tagNames[tag], V, elapsedSeconds(&start), labels.count);
+
+    free(labelCount);
+    free(labels.vertex);
+    free(labels.poi);
+    freeMinHeap(heap);
+    freeCSR(reverse);
+}
+
+
+// A label is a (distance, facility) pair packed into one word, so comparing
+// labels compares distances first and breaks ties by facility. The parallel
+// search keeps them in atomics and lowers them with compare-and-swap.
+unsigned long long voronoiLabel(int distance, int facility)
+{
+    return (unsigned long long)distance << 32 | (unsigned int)facility;
+}
+
+
+// Multi-source Dijkstra: every facility starts at distance 0.
+void voronoiSequential(struct Graph *graph, int facilityCount, int *facilities, unsigned long long *label)
+{
+    struct MinHeap *heap = createMinHeap(facilityCount);
+    for (int f = 0; f < facilityCount; f++)
+    {
+        int s = toInternal(graph, facilities[f]);
+        if (voronoiLabel(0, f) < label[s])
+        {
+            label[s] = voronoiLabel(0, f);
+            heapPushOrdered(heap, 0, f, s);
+        }
+    }
+    while (heap->size > 0)
+    {
+        struct HeapEntry entry = heapPop(heap);
+        int u = entry.vertex;
+        if (voronoiLabel(entry.key, entry.order) != label[u])
+        {
+            continue;
+        }
+        struct EdgeCursor cursor;
+        int v, distance;
+        enum Direction direction;
+        firstEdge(graph, u, &cursor);
+        while (nextEdge(&cursor, &v, &distance, &direction))
+        {
+            if (entry.key > INT_MAX - distance)
+            {
+                continue;
+            }
+            unsigned long long reached = voronoiLabel(entry.key + distance, entry.order);
+            if (reached < label[v])
+            {
+                label[v] = reached;
+                heapPushOrdered(heap, entry.key + distance, entry.order, v);
+            }
+        }
+    }
+    freeMinHeap(heap);
+}
+
+
+void voronoiPush(struct VoronoiSearch *search, int thread, int bucket, int v)
+{
+    if (bucket >= search->bucketSize[thread])
+    {
+        int size = bucket + 1 > 2 * search->bucketSize[thread] ? bucket + 1 : 2 * search->bucketSize[thread];
+        search->buckets[thread] = (struct VoronoiBucket *)realloc(search->buckets[thread],
+                                                                  size * sizeof(struct VoronoiBucket));
+        if (!search->buckets[thread])
+        {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+        memset(search->buckets[thread] + search->bucketSize[thread], 0,
+               (size - search->bucketSize[thread]) * sizeof(struct VoronoiBucket));
+        search->bucketSize[thread] = size;
+    }
+    struct VoronoiBucket *entry = &search->buckets[thread][bucket];
+    if (entry->count == entry->capacity)
+    {
+        entry->capacity = entry->capacity ? entry->capacity * 2 : 64;
+        entry->vertices = (int *)realloc(entry->vertices, entry->capacity * sizeof(int));
+        if (!entry->vertices)
+        {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    entry->vertices[entry->count++] = v;
+}
+
+
+// Collects the lowest non-empty bucket from every thread as the next phase.
+// A bucket is revisited until relaxing it stops adding to it; buckets below
+// it are then final and their lists are freed.
+void nextVoronoiPhase(struct VoronoiSearch *search)
+{
+    int threads = search->threads;
+    for (int b = search->bucket;; b++)
+    {
+        bool exists = false;
+        for (int t = 0; t < threads; t++)
+        {
+            if (b < search->bucketSize[t])
+            {
+                exists = true;
+                struct VoronoiBucket *entry = &search->buckets[t][b];
+                if (entry->count == 0)
+                {
+                    continue;
+                }
+                if (search->currentCount + entry->count > search->currentCapacity)
+                {
+                    search->currentCapacity = 2 * (search->currentCount + entry->count);
+                    search->current = (int *)realloc(search->current, search->currentCapacity * sizeof(int));
+                    if (!search->current)
+                    {
+                        perror("Memory allocation failed");
+                        exit(EXIT_FAILURE);
+                    }
+                }
+                memcpy(search->current + search->currentCount, entry->vertices, entry->count * sizeof(int));
+                search->currentCount += entry->count;
+                entry->count = 0;
+            }
+        }
+        if (!exists)
+        {
+            search->done = true;
+            return;
+        }
+        if (search->currentCount > 0)
+        {
+            search->bucket = b;
+            return;
+        }
+        for (int t = 0; t < threads; t++)
+        {
+            if (b < search->bucketSize[t])
+            {
+                free(search->buckets[t][b].vertices);
+                search->buckets[t][b].vertices = NULL;
+                search->buckets[t][b].capacity = 0;
+            }
+        }
+    }
+}
+
+
+// Delta-stepping: each phase relaxes, in parallel, every edge out of the
+// vertices queued for the current bucket. Vertices whose label drops are
+// queued in the thread's own lists for the bucket of their new distance,
+// which is the current one again for edges shorter than delta.
+void *voronoiWorker(void *arg)
+{
+    struct VoronoiWorker *worker = (struct VoronoiWorker *)arg;
+    struct VoronoiSearch *search = worker->search;
+    struct CSRGraph *csr = search->csr;
+    while (true)
+    {
+        pthread_barrier_wait(&search->barrier);
+        if (search->done)
+        {
+            break;
+        }
+        int first;
+        while ((first = atomic_fetch_add(&search->next, VORONOI_CHUNK)) < search->currentCount)
+        {
+            int last = first + VORONOI_CHUNK < search->currentCount ? first + VORONOI_CHUNK : search->currentCount;
+            for (int i = first; i < last; i++)
+            {
+                int u = search->current[i];
+                unsigned long long label = atomic_load(&search->label[u]);
+                int distance = (int)(label >> 32);
+                unsigned int facility = (unsigned int)label;
+                for (int e = csr->offsets[u]; e < csr->offsets[u + 1]; e++)
+                {
+                    int v = csr->targets[e];
+                    if (distance > INT_MAX - csr->weights[e])
+                    {
+                        continue;
+                    }
+                    int reached = distance + csr->weights[e];
+                    unsigned long long proposed = voronoiLabel(reached, facility);
+                    unsigned long long old = atomic_load(&search->label[v]);
+                    while (proposed < old)
+                    {
+                        if (atomic_compare_exchange_weak(&search->label[v], &old, proposed))
+                        {
+                            voronoiPush(search, worker->id, reached / search->delta, v);
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+        pthread_barrier_wait(&search->barrier);
+        if (worker->id == 0)
+        {
+            search->currentCount = 0;
+            atomic_store(&search->next, 0);
+            nextVoronoiPhase(search);
+        }
+    }
+    return NULL;
+}
+
+
+// Labels every vertex with its nearest facility (a point of interest with
+// the given tag, or any tag when tag is -1) and its distance from it, using
+// one search seeded with all facilities at distance 0. Large maps use the
+// parallel delta-stepping search; both give the same labels, ties going to
+// the facility listed first.
+void nearestFacilityPartition(struct Graph *graph, int tag, const char *filename)
+{
+    struct PoiIndex *pois = graph->pois;
+    int V = graph->V;
+    int facilityCount = 0;
+    int *facilities = (int *)malloc((pois->count + 1) * sizeof(int));
+    if (!facilities)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    for (int p = 0; p < pois->count; p++)
+    {
+        if (tag == -1 || pois->tag[p] == tag)
+        {
+            facilities[facilityCount++] = pois->vertex[p];
+        }
+    }
+
+    FILE *file = fopen(filename, "w");
+    if (!file)
+    {
+        perror("Failed to open the file for writing");
+        free(facilities);
+        return;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int threads = V >= VORONOI_PARALLEL_MIN ? availableThreads() : 1;
+    unsigned long long *label = (unsigned long long *)malloc(V * sizeof(unsigned long long));
+    if (!label)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    int delta = 0;
+    if (threads == 1)
+    {
+        for (int v = 0; v < V; v++)
+        {
+            label[v] = ULLONG_MAX;
+        }
+        voronoiSequential(graph, facilityCount, facilities, label);
+    }
+    else
+    {
+        struct CSRGraph *csr = graph->range->forward;
+        long long totalWeight = 0;
+        for (int e = 0; e < csr->E; e++)
+        {
+            totalWeight += csr->weights[e];
+        }
+        delta = csr->E > 0 && totalWeight / csr->E > 0 ? (int)(totalWeight / csr->E) : 1;
+
+        struct VoronoiSearch search;
+        memset(&search, 0, sizeof(search));
+        search.csr = csr;
+        search.threads = threads;
+        search.delta = delta;
+        search.label = (_Atomic unsigned long long *)malloc(V * sizeof(_Atomic unsigned long long));
+        search.buckets = (struct VoronoiBucket **)calloc(threads, sizeof(struct VoronoiBucket *));
+        search.bucketSize = (int *)calloc(threads, sizeof(int));
+        pthread_t *workers = (pthread_t *)malloc(threads * sizeof(pthread_t));
+        struct VoronoiWorker *args = (struct VoronoiWorker *)malloc(threads * sizeof(struct VoronoiWorker));
+        if (!search.label || !search.buckets || !search.bucketSize || !workers || !args)
+        {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+        for (int v = 0; v < V; v++)
+        {
+            atomic_init(&search.label[v], ULLONG_MAX);
+        }
+        for (int f = 0; f < facilityCount; f++)
+        {
+            int s = toInternal(graph, facilities[f]);
+            if (voronoiLabel(0, f) < atomic_load(&search.label[s]))
+            {
+                atomic_store(&search.label[s], voronoiLabel(0, f));
+                voronoiPush(&search, 0, 0, s);
+            }
+        }
+        atomic_init(&search.next, 0);
+        nextVoronoiPhase(&search);
+
+        pthread_barrier_init(&search.barrier, NULL, threads);
+        for (int t = 0; t < threads; t++)
+        {
+            args[t].search = &search;
+            args[t].id = t;
+        }
+        for (int t = 1; t < threads; t++)
+        {
+            pthread_create(&workers[t], NULL, voronoiWorker, &args[t]);
+        }
+        voronoiWorker(&args[0]);
+        for (int t = 1; t < threads; t++)
+        {
+            pthread_join(workers[t], NULL);
+        }
+        pthread_barrier_destroy(&search.barrier);
+
+        for (int v = 0; v < V; v++)
+        {
+            label[v] = atomic_load(&search.label[v]);
+        }
+        for (int t = 0; t < threads; t++)
+        {
+            for (int b = 0; b < search.bucketSize[t]; b++)
+            {
+                free(search.buckets[t][b].vertices);
+            }
+            free(search.buckets[t]);
+        }
+        free(search.buckets);
+        free(search.bucketSize);
+        free(search.current);
+        free((void *)search.label);
+        free(workers);
+        free(args);
+    }
+    double millis = elapsedSeconds(&start) * 1000;
+
+    int *territory = (int *)calloc(facilityCount + 1, sizeof(int));
+    if (!territory)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    int reached = 0, largest = 0, farthest = -1;
+    for (int x = 0; x < V; x++)
+    {
+        int v = toInternal(graph, x);
+        if (label[v] == ULLONG_MAX)
+        {
+            continue;
+        }
+        int f = (int)(unsigned int)label[v];
+        int distance = (int)(label[v] >> 32);
+        fprintf(file, "%lld %lld %d\n", mapId(graph, x), mapId(graph, facilities[f]), distance);
+        reached++;
+        territory[f]++;
+        largest = territory[f] > territory[largest] ? f : largest;
+        if (farthest == -1 || distance > (int)(label[farthest] >> 32))
+        {
+            farthest = v;
+        }
+    }
+    fclose(file);
+
+    printf("Assigned %d of %d vertices to %d facilities in %.3f ms", reached, V, facilityCount, millis);
+    if (threads > 1)
+    {
+        printf(" (delta-stepping, %d threads, delta %d)", threads, delta);
+    }
+    printf("; written to %s.\n", filename);
+    if (reached > 0)
+    {
+        printf("Largest territory: %d vertices around %lld. Farthest vertex: %lld, %d from %lld.\n",
+               territory[largest], mapId(graph, facilities[largest]), vertexId(graph, farthest),
+               (int)(label[farthest] >> 32), mapId(graph, facilities[(unsigned int)label[farthest]]));
+    }
+    free(territory);
+    free(label);
+    free(facilities);
+}
+
+
+// Brandes' algorithm, one source at a time. The forward pass is Dijkstra
+// counting shortest paths (sigma); an edge u -> v is on a shortest path when
+// u settled before v and the distances match. The backward pass visits the
+// vertices in reverse settling order and adds up the dependency of each on
+// its successors, crediting every tight edge with its share as well.
+void *betweennessWorker(void *arg)
+{
+    struct BetweennessWorker *worker = (struct BetweennessWorker *)arg;
+    struct BetweennessJob *job = worker->job;
+    struct CSRGraph *csr = job->csr;
+    int *distance = worker->distance, *position = worker->position, *settled = worker->settled;
+    double *sigma = worker->sigma, *dependency = worker->dependency;
+    int k;
+    while ((k = atomic_fetch_add(&job->next, 1)) < job->sourceCount)
+    {
+        int s = job->sources[k], count = 0;
+        distance[s] = 0;
+        sigma[s] = 1;
+        heapPush(worker->heap, 0, s);
+        while (worker->heap->size > 0)
+        {
+            struct HeapEntry entry = heapPop(worker->heap);
+            int u = entry.vertex;
+            if (position[u] != -1 || entry.key > distance[u])
+            {
+                continue;
+            }
+            position[u] = count;
+            settled[count++] = u;
+            for (int e = csr->offsets[u]; e < csr->offsets[u + 1]; e++)
+            {
+                int v = csr->targets[e];
+                if (position[v] != -1 || distance[u] > INT_MAX - 1 - csr->weights[e])
+                {
+                    continue;
+                }
+                int reached = distance[u] + csr->weights[e];
+                if (reached < distance[v])
+                {
+                    distance[v] = reached;
+                    sigma[v] = sigma[u];
+                    heapPush(worker->heap, reached, v);
+                }
+                else if (reached == distance[v])
+                {
+                    sigma[v] += sigma[u];
+                }
+            }
+        }
+
+        for (int i = count - 1; i >= 0; i--)
+        {
+            int u = settled[i];
+            double total = 0;
+            for (int e = csr->offsets[u]; e < csr->offsets[u + 1]; e++)
+            {
+                int v = csr->targets[e];
+                if (position[v] > i && distance[u] + csr->weights[e] == distance[v])
+                {
+                    double share = sigma[u] / sigma[v] * (1 + dependency[v]);
+                    worker->edgeScore[e] += share;
+                    total += share;
+                }
+            }
+            dependency[u] = total;
+            if (u != s)
+            {
+                worker->vertexScore[u] += total;
+            }
+        }
+        for (int i = 0; i < count; i++)
+        {
+            int u = settled[i];
+            distance[u] = INT_MAX;
+            position[u] = -1;
+        }
+    }
+    return NULL;
+}
+
+
+int compareRankedScore(const void *a, const void *b)
+{
+    const struct RankedScore *x = (const struct RankedScore *)a;
+    const struct RankedScore *y = (const struct RankedScore *)b;
+    if (x->score != y->score)
+    {
+        return x->score > y->score ? -1 : 1;
+    }
+    return x->index - y->index;
+}
+
+
+// Betweenness of every vertex and edge: the number of source-target pairs
+// whose shortest paths run through it, each pair split evenly among its
+// shortest paths. Sources are spread over the threads. With samples > 0 only
+// that many random sources are searched and the scores are scaled up; by
+// Hoeffding's bound and a union bound over the vertices, every normalised
+// vertex score is then within the printed margin with the given confidence.
+void betweennessCentrality(struct Graph *graph, int top, int samples)
+{
+    struct CSRGraph *csr = graph->range->forward;
+    int V = graph->V;
+    if (V < 3)
+    {
+        printf("Betweenness needs at least three vertices.\n");
+        return;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    struct BetweennessJob job;
+    job.csr = csr;
+    job.sourceCount = samples > 0 && samples < V ? samples : V;
+    job.sources = (int *)malloc(V * sizeof(int));
+    if (!job.sources)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    atomic_init(&job.next, 0);
+    for (int v = 0; v < V; v++)
+    {
+        job.sources[v] = v;
+    }
+    // Partial Fisher-Yates shuffle for the sampled sources.
+    unsigned long long seed = (unsigned long long)start.tv_nsec ^ (unsigned long long)start.tv_sec << 30;
+    for (int k = 0; job.sourceCount < V && k < job.sourceCount; k++)
+    {
+        int pick = k + (int)(hashId((long long)(seed + k)) % (unsigned long long)(V - k));
+        int swap = job.sources[k];
+        job.sources[k] = job.sources[pick];
+        job.sources[pick] = swap;
+    }
+
+    int threads = availableThreads();
+    threads = threads < job.sourceCount ? threads : job.sourceCount;
+    struct BetweennessWorker *workers = (struct BetweennessWorker *)malloc(threads * sizeof(struct BetweennessWorker));
+    pthread_t *ids = (pthread_t *)malloc(threads * sizeof(pthread_t));
+    if (!workers || !ids)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    for (int t = 0; t < threads; t++)
+    {
+        struct BetweennessWorker *worker = &workers[t];
+        worker->job = &job;
+        worker->distance = (int *)malloc(V * sizeof(int));
+        worker->sigma = (double *)malloc(V * sizeof(double));
+        worker->dependency = (double *)malloc(V * sizeof(double));
+        worker->position = (int *)malloc(V * sizeof(int));
+        worker->settled = (int *)malloc(V * sizeof(int));
+        worker->heap = createMinHeap(64);
+        worker->vertexScore = (double *)calloc(V, sizeof(double));
+        worker->edgeScore = (double *)calloc(csr->E + 1, sizeof(double));
+        if (!worker->distance || !worker->sigma || !worker->dependency || !worker->position || !worker->settled ||
+            !worker->vertexScore || !worker->edgeScore)
+        {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+        for (int v = 0; v < V; v++)
+        {
+            worker->distance[v] = INT_MAX;
+            worker->position[v] = -1;
+        }
+    }
+    for (int t = 1; t < threads; t++)
+    {
+        pthread_create(&ids[t], NULL, betweennessWorker, &workers[t]);
+    }
+    betweennessWorker(&workers[0]);
+    for (int t = 1; t < threads; t++)
+    {
+        pthread_join(ids[t], NULL);
+    }
+
+    double *vertexScore = workers[0].vertexScore, *edgeScore = workers[0].edgeScore;
+    double scale = (double)V / job.sourceCount;
+    for (int t = 1; t < threads; t++)
+    {
+        for (int v = 0; v < V; v++)
+        {
+            vertexScore[v] += workers[t].vertexScore[v];
+        }
+        for (int e = 0; e < csr->E; e++)
+        {
+            edgeScore[e] += workers[t].edgeScore[e];
+        }
+    }
+    double seconds = elapsedSeconds(&start);
+
+    int count = V > csr->E ? V : csr->E;
+    struct RankedScore *ranked = (struct RankedScore *)malloc((count + 1) * sizeof(struct RankedScore));
+    int *edgeSource = (int *)malloc((csr->E + 1) * sizeof(int));
+    if (!ranked || !edgeSource)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    double pairs = (double)(V - 1) * (V - 2);
+    printf("Betweenness from %d of %d sources in %.3f s using %d threads.\n", job.sourceCount, V, seconds, threads);
+    if (job.sourceCount < V)
+    {
+        double margin = (double)V / (V - 1) * sqrt(log(2.0 * V / BETWEENNESS_FAILURE) / (2.0 * job.sourceCount));
+        printf("Sampled estimate: with %.0f%% confidence every normalized vertex score is within %.4f.\n",
+               100 * (1 - BETWEENNESS_FAILURE), margin);
+    }
+
+    for (int v = 0; v < V; v++)
+    {
+        ranked[v].index = v;
+        ranked[v].score = vertexScore[v] * scale;
+    }
+    qsort(ranked, V, sizeof(struct RankedScore), compareRankedScore);
+    printf("Top intersections:\n");
+    for (int k = 0; k < top && k < V; k++)
+    {
+        printf("  %lld: %.1f (normalized %.4f)\n", vertexId(graph, ranked[k].index), ranked[k].score,
+               ranked[k].score / pairs);
+    }
+
+    for (int u = 0; u < V; u++)
+    {
+        for (int e = csr->offsets[u]; e < csr->offsets[u + 1]; e++)
+        {
+            edgeSource[e] = u;
+        }
+    }
+    for (int e = 0; e < csr->E; e++)
+    {
+        ranked[e].index = e;
+        ranked[e].score = edgeScore[e] * scale;
+    }
+    qsort(ranked, csr->E, sizeof(struct RankedScore), compareRankedScore);
+    printf("Top road segments:\n");
+    for (int k = 0; k < top && k < csr->E; k++)
+    {
+        int e = ranked[k].index;
+        printf("  %lld -> %lld (%s, distance %d): %.1f\n", vertexId(graph, edgeSource[e]),
+               vertexId(graph, csr->targets[e]), directionName((enum Direction)csr->directions[e]), csr->weights[e],
+               ranked[k].score);
+    }
+
+    for (int t = 0; t < threads; t++)
+    {
+        free(workers[t].distance);
+        free(workers[t].sigma);
+        free(workers[t].dependency);
+        free(workers[t].position);
+        free(workers[t].settled);
+        freeMinHeap(workers[t].heap);
+        free(workers[t].vertexScore);
+        free(workers[t].edgeScore);
+    }
+    free(workers);
+    free(ids);
+    free(job.sources);
+    free(ranked);
+    free(edgeSource);
+}
+
+
+// Renumbers the vertices so that neighbours sit close together in memory.
+// Searches run on the new internal numbering; toExternal/toInternal translate
+// at the menu so every printed result keeps the IDs from the map file.
+void reorderGraph(struct Graph *graph, enum VertexOrdering ordering)
+{
+    if (graph->compressed)
+    {
+        printf("The adjacency is already compressed. Reorder before compressing.\n");
+        return;
+    }
+    if (graph->tiles)
+    {
+        printf("Tiled maps are already ordered for locality when they are written.\n");
+        return;
+    }
+
+    int V = graph->V;
+    int *offsets = (int *)calloc(V + 1, sizeof(int));
+    int *newOrder = (int *)malloc(V * sizeof(int));
+    int *position = (int *)malloc(V * sizeof(int));
+    struct VertexDegree *seeds = (struct VertexDegree *)malloc(V * sizeof(struct VertexDegree));
+    if (!offsets || !newOrder || !position || !seeds)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+
+    // Locality is symmetric, so order over the undirected view of the map.
+    long long spanBefore = 0, edgeCount = 0;
+    for (int u = 0; u < V; u++)
+    {
+        for (struct Node *temp = *adjacencySlot(graph->adjList, u); temp; temp = temp->next)
+        {
+            if (temp->data != u)
+            {
+                offsets[u + 1]++;
+                offsets[temp->data + 1]++;
+            }
+            spanBefore += abs(u - temp->data);
+            edgeCount++;
+        }
+    }
+    for (int u = 0; u < V; u++)
+    {
+        offsets[u + 1] += offsets[u];
+    }
+
+    int *neighbors = (int *)malloc((offsets[V] > 0 ? offsets[V] : 1) * sizeof(int));
+    int *fill = (int *)malloc(V * sizeof(int));
+    if (!neighbors || !fill)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(fill, offsets, V * sizeof(int));
+    for (int u = 0; u < V; u++)
+    {
+        for (struct Node *temp = *adjacencySlot(graph->adjList, u); temp; temp = temp->next)
+        {
+            if (temp->data != u)
+            {
+                neighbors[fill[u]++] = temp->data;
+                neighbors[fill[temp->data]++] = u;
+            }
+        }
+    }
+
+    for (int u = 0; u < V; u++)
+    {
+        seeds[u].degree = ordering == ORDER_RCM ? offsets[u + 1] - offsets[u] : 0;
+        seeds[u].vertex = u;
+        position[u] = -1;
+    }
+    if (ordering == ORDER_RCM)
+    {
+        qsort(seeds, V, sizeof(struct VertexDegree), compareVertexDegree);
+    }
+
+    // fill is reused as the scratch list of unvisited neighbours for RCM.
+    int head = 0;
+    for (int s = 0; s < V; s++)
+    {
+        int start = seeds[s].vertex;
+        if (position[start] != -1)
+        {
+            continue;
+        }
+        position[start] = head;
+        newOrder[head++] = start;
+
+        for (int scan = position[start]; scan < head; scan++)
+        {
+            int u = newOrder[scan];
+            int found = 0;
+            for (int k = offsets[u]; k < offsets[u + 1]; k++)
+            {
+                int w = neighbors[k];
+                if (position[w] == -1)
+                {
+                    position[w] = head;
+                    newOrder[head++] = w;
+                    found++;
+                }
+            }
+
+            if (ordering == ORDER_RCM && found > 1)
+            {
+                for (int k = 0; k < found; k++)
+                {
+                    fill[k] = newOrder[head - found + k];
+                }
+                for (int k = 1; k < found; k++)
+                {
+                    int w = fill[k];
+                    int degree = offsets[w + 1] - offsets[w];
+                    int j = k - 1;
+                    while (j >= 0 && offsets[fill[j] + 1] - offsets[fill[j]] > degree)
+                    {
+                        fill[j + 1] = fill[j];
+                        j--;
+                    }
+                    fill[j + 1] = w;
+                }
+                for (int k = 0; k < found; k++)
+                {
+                    newOrder[head - found + k] = fill[k];
+                    position[fill[k]] = head - found + k;
+                }
+            }
+        }
+    }
+
+    if (ordering == ORDER_RCM)
+    {
+        for (int k = 0; k < V / 2; k++)
+        {
+            int swap = newOrder[k];
+            newOrder[k] = newOrder[V - 1 - k];
+            newOrder[V - 1 - k] = swap;
+        }
+        for (int k = 0; k < V; k++)
+        {
+            position[newOrder[k]] = k;
+        }
+    }
+
+    // Copy the lists in the new order so the nodes are also allocated close
+    // together, keeping each list's original edge order.
+    struct Node ***adjList = growAdjacency(NULL, 0, V);
+    int *order = (int *)malloc(V * sizeof(int));
+    int *rank = (int *)malloc(V * sizeof(int));
+    if (!order || !rank)
+    {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+
+    long long spanAfter = 0;
+    for (int k = 0; k < V; k++)
+    {
+        int old = newOrder[k];
+        struct Node **link = adjacencySlot(adjList, k);
+        *link = NULL;
+        for (struct Node *temp = *adjacencySlot(graph->adjList, old); temp; temp = temp->next)
+        {
+            *link = createNode(position[temp->data], temp->distance, temp->direction);
+            (*link)->profile = temp->profile;
+            link = &(*link)->next;
+            spanAfter += abs(k - position[temp->data]);
+        }
+        order[k] = toExternal(graph, old);
+        rank[order[k]] = k;
+    }
+
+    for (int u = 0; u < V; u++)
+    {
+        struct Node *temp = *adjacencySlot(graph->adjList, u);
+        while (temp)
+        {
+            struct Node *next = temp->next;
+            free(temp);
+            temp = next;
+        }
+    }
+    freeAdjacency(graph->adjList, V);
+    free(graph->order);
+    free(graph->rank);
+    graph->adjList = adjList;
+    graph->order = order;
+    graph->rank = rank;
+    if (graph->connectivity)
+    {
+        freeConnectivityIndex(graph->connectivity);
+        graph->connectivity = buildConnectivityIndex(graph);
+    }
+    if (graph->overlay)
+    {
+        freeOverlay(graph->overlay);
+        graph->overlay = NULL;
+        printf("The multilevel overlay was dropped; build it again for the new numbering.\n");
+    }
+    if (graph->chains)
+    {
+        freeChainContraction(graph->chains);
+        graph->chains = NULL;
+        printf("The chain contraction was dropped; build it again for the new numbering.\n");
+    }
+    freeRangeIndex(graph->range);
+    graph->range = NULL;
+    if (graph->pois)
+    {
+        linkPointsOfInterest(graph);
+        freeNearestPoiIndex(graph->pois);
+    }
+
+    printf("Reordered %d vertices (%s). Average edge span: %.1f -> %.1f\n", V,
+           ordering == ORDER_RCM ? "Reverse Cuthill-McKee" : "BFS",
+           edgeCount ? (double)spanBefore / edgeCount : 0.0,
+           edgeCount ? (double)spanAfter / edgeCount : 0.0);
+
+    free(offsets);
+    free(neighbors);
+    free(fill);
+    free(newOrder);
+    free(position);
+    free(seeds);
+}
+
+// Frees everything except the adjacency list nodes and vertex blocks, which a
+// snapshot may share with the next one.
+void freeGraphShell(struct Graph *graph)
 {
-    int V;
-    struct Node **adjList;
-    int *minDistance;
-};
+    free(graph->adjList);
+    if (graph->compressed)
+    {
+        free(graph->compressed->offsets);
+        free(graph->compressed->bytes);
+        free(graph->compressed);
+    }
+    freeTiledMap(graph->tiles);
+    freeConnectivityIndex(graph->connectivity);
+    freeHubLabels(graph->hubLabels);
+    freeOverlay(graph->overlay);
+    freeChainContraction(graph->chains);
+    freeProfilePool(graph->profiles);
+    freeRangeIndex(graph->range);
+    freePointsOfInterest(graph->pois);
+    freeIdTable(graph->ids);
+    free(graph->order);
+    free(graph->rank);
+    free(graph);
+}
 
 
-struct Node *createNode(int data, int distance, enum Direction direction)
+void freeGraph(struct Graph *graph)
 {
-    struct Node *newNode = (struct Node *)malloc(sizeof(struct Node));
-    if (!newNode)
+    for (int i = 0; graph->adjList && i < graph->V; i++)
     {
-        perror("Memory allocation failed");
-        exit(EXIT_FAILURE);
+        struct Node *temp = *adjacencySlot(graph->adjList, i);
+        while (temp)
+        {
+            struct Node *next = temp->next;
+            free(temp);
+            temp = next;
+        }
     }
-    newNode->data = data;
-    newNode->distance = distance;
-    newNode->direction = direction;
-    newNode->next = NULL;
-    return newNode;
+    for (int b = 0; graph->adjList && b < adjacencyBlocks(graph->V); b++)
+    {
+        free(graph->adjList[b]);
+    }
+    freeGraphShell(graph);
 }
 
 
-struct Graph *createGraph(int V)
+struct Graph *loadMap(const char *filename, bool compressed, size_t tileCache)
 {
-    struct Graph *graph = (struct Graph *)malloc(sizeof(struct Graph));
-    if (!graph)
+    struct Graph *graph;
+    if (hasMagic(filename, "MAPTILE1"))
     {
-        perror("Memory allocation failed");
-        exit(EXIT_FAILURE);
+        graph = loadTiledMap(filename, tileCache);
     }
-    graph->V = V;
-    graph->adjList = (struct Node **)malloc(V * sizeof(struct Node *));
-    graph->minDistance = (int *)malloc(V * sizeof(int));
-    if (!graph->adjList || !graph->minDistance)
+    else if (hasMagic(filename, "MAPPACK1"))
     {
-        perror("Memory allocation failed");
-        exit(EXIT_FAILURE);
+        graph = loadPackedMap(filename, compressed);
+    }
+    else
+    {
+        graph = compressed ? loadCompressedMapFromFile(filename) : loadMapFromFile(filename);
     }
-    for (int i = 0; i < V; i++)
+    // The connectivity index would page in every tile of a tiled map.
+    if (graph && !graph->tiles)
     {
-        graph->adjList[i] = NULL;
-        graph->minDistance[i] = 100000; 
+        graph->connectivity = buildConnectivityIndex(graph);
     }
     return graph;
 }
 
 
-void DFS(struct Graph *graph, int src, int dest, bool visited[], int path[], int totalDistance, int pathIndex)
+#ifdef EMBEDDED_MAP
+// The edges stay in the compiled-in arrays; only the indexes are built.
+struct Graph *loadEmbeddedMap(void)
 {
-    visited[src] = true;
-    path[pathIndex] = src;
-    pathIndex++;
+    struct Graph *graph = createGraph(EMBEDDED_V);
+    freeAdjacency(graph->adjList, EMBEDDED_V);
+    graph->adjList = NULL;
+    for (int k = 0; k < EMBEDDED_POIS; k++)
+    {
+        addPointOfInterest(graph, embeddedPoiVertices[k], embeddedPoiTags[k]);
+    }
+    indexPointsOfInterest(graph);
+    graph->connectivity = buildConnectivityIndex(graph);
+    return graph;
+}
+#endif
 
-    if (src == dest)
+
+// Epoch-based reclamation: a reader publishes the epoch it entered at before
+// it loads the current graph, and a replaced graph is retired with the epoch
+// of its swap. It is freed once no reader is still inside that epoch or an
+// earlier one, i.e. once every reader that could have seen it has left.
+struct Graph *enterMap(struct MapHandle *map, int reader)
+{
+    atomic_store(&map->readers[reader], atomic_load(&map->epoch));
+    return atomic_load(&map->current);
+}
+
+
+void leaveMap(struct MapHandle *map, int reader)
+{
+    atomic_store(&map->readers[reader], 0);
+}
+
+
+void reclaimRetiredGraphs(struct MapHandle *map)
+{
+    pthread_mutex_lock(&map->lock);
+    struct RetiredGraph **link = &map->retired;
+    while (*link)
     {
-        printf("Path: ");
-        for (int i = 0; i < pathIndex; i++)
+        struct RetiredGraph *retired = *link;
+        bool inUse = false;
+        for (int r = 0; r < MAX_MAP_READERS && !inUse; r++)
         {
-            printf("%d", path[i]);
-            if (i < pathIndex - 1)
+            unsigned int entered = atomic_load(&map->readers[r]);
+            inUse = entered != 0 && entered <= retired->epoch;
+        }
+        if (inUse)
+        {
+            link = &retired->next;
+            continue;
+        }
+        *link = retired->next;
+        if (retired->sharesLists)
+        {
+            for (int k = 0; k < retired->supersededCount; k++)
             {
-                struct Node *edge = graph->adjList[path[i]];
-                while (edge->data != path[i + 1])
-                {
-                    edge = edge->next;
-                }
-                char *directionStr;
-                switch (edge->direction) {
-                    case RIGHT:
-                        directionStr = "right";
-                        break;
-                    case LEFT:
-                        directionStr = "left";
-                        break;
-                    case STRAIGHT:
-                        directionStr = "straight";
-                        break;
-                    case BACK:
-                        directionStr = "back";
-                        break;
-                }
-                printf(" (%s) -> ", directionStr);
+                free(retired->superseded[k]);
+            }
+            free(retired->superseded);
+            for (int k = 0; k < retired->supersededBlockCount; k++)
+            {
+                free(retired->supersededBlocks[k]);
+            }
+            free(retired->supersededBlocks);
+            struct Graph *graph = retired->graph;
+            if (retired->sharesOrder)
+            {
+                graph->order = NULL;
+                graph->rank = NULL;
+            }
+            if (retired->sharesIds)
+            {
+                graph->ids = NULL;
             }
+            if (retired->sharesConnectivity)
+            {
+                atomic_store(&graph->connectivity, NULL);
+            }
+            freeGraphShell(graph);
         }
-        printf("\n");
+        else
+        {
+            freeGraph(retired->graph);
+        }
+        free(retired);
+    }
+    pthread_mutex_unlock(&map->lock);
+}
 
-        printf("Total Distance: %d\n", totalDistance);
+
+// Publishes graph; the caller holds map->writer. retired describes what the
+// old version shares with the new one, or is NULL when it shares nothing.
+void swapMap(struct MapHandle *map, struct Graph *graph, struct RetiredGraph *retired)
+{
+    if (!retired)
+    {
+        retired = (struct RetiredGraph *)calloc(1, sizeof(struct RetiredGraph));
+        if (!retired)
+        {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
     }
-    else
+    retired->graph = atomic_exchange(&map->current, graph);
+    retired->epoch = atomic_fetch_add(&map->epoch, 1);
+    pthread_mutex_lock(&map->lock);
+    retired->next = map->retired;
+    map->retired = retired;
+    pthread_mutex_unlock(&map->lock);
+    reclaimRetiredGraphs(map);
+}
+
+
+// Waits for SIGHUP (sent by the operator or by the reload menu entry), loads
+// the map in the background and swaps it in. Readers keep the version they
+// entered with; retired versions are reclaimed on the periodic wake-ups.
+void *mapWatcher(void *arg)
+{
+    struct MapHandle *map = (struct MapHandle *)arg;
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGHUP);
+    struct timespec timeout = {1, 0};
+    while (!atomic_load(&map->stopping))
     {
-        struct Node *temp = graph->adjList[src];
-        while (temp)
+        if (sigtimedwait(&signals, NULL, &timeout) != SIGHUP || atomic_load(&map->stopping))
         {
-            int neighbor = temp->data;
-            if (!visited[neighbor])
-            {
-                int edgeDistance = temp->distance;
-                totalDistance += edgeDistance;
-                DFS(graph, neighbor, dest, visited, path, totalDistance, pathIndex);
-                totalDistance -= edgeDistance;
-            }
-            temp = temp->next;
+            reclaimRetiredGraphs(map);
+            continue;
         }
+
+        char filename[256];
+        pthread_mutex_lock(&map->lock);
+        if (map->pendingFile[0])
+        {
+            strcpy(map->filename, map->pendingFile);
+            map->pendingFile[0] = '\0';
+        }
+        strcpy(filename, map->filename);
+        pthread_mutex_unlock(&map->lock);
+
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        struct Graph *graph = loadMap(filename, map->compressed, map->tileCache);
+        if (!graph)
+        {
+            printf("\nReloading %s failed; keeping the current map.\n", filename);
+            continue;
+        }
+        pthread_mutex_lock(&map->writer);
+        swapMap(map, graph, NULL);
+        pthread_mutex_unlock(&map->writer);
+        printf("\nReloaded %s (%d vertices) in %.3f s.\n", filename, graph->V, elapsedSeconds(&start));
+        fflush(stdout);
     }
+    return NULL;
+}
 
-    visited[src] = false; 
+
+void requestMapReload(struct MapHandle *map, const char *filename)
+{
+    pthread_mutex_lock(&map->lock);
+    strcpy(map->pendingFile, filename);
+    pthread_mutex_unlock(&map->lock);
+    pthread_kill(map->watcher, SIGHUP);
+}
+
+
+// Stages an edge for the next commit. Vertices are named by their map IDs,
+// which are only resolved at commit time; new IDs grow the map.
+void addEdge(struct MapEditor *editor, long long src, long long dest, int distance, enum Direction direction)
+{
+    if (editor->count == editor->capacity)
+    {
+        editor->capacity = editor->capacity ? editor->capacity * 2 : 64;
+        editor->edits = (struct StagedEdge *)realloc(editor->edits, editor->capacity * sizeof(struct StagedEdge));
+        if (!editor->edits)
+        {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    struct StagedEdge *edit = &editor->edits[editor->count];
+    edit->sequence = editor->count++;
+    edit->srcId = src;
+    edit->destId = dest;
+    edit->distance = distance;
+    edit->direction = direction;
 }
 
 
+int compareStagedEdge(const void *a, const void *b)
+{
+    const struct StagedEdge *x = (const struct StagedEdge *)a;
+    const struct StagedEdge *y = (const struct StagedEdge *)b;
+    if (x->src != y->src)
+    {
+        return x->src < y->src ? -1 : 1;
+    }
+    return x->sequence < y->sequence ? -1 : (x->sequence > y->sequence);
+}
+
 
-void findPaths(struct Graph *graph, int src, int dest)
+void addSupersededNode(struct RetiredGraph *retired, struct Node *node)
 {
-    if (src < 0 || src >= graph->V || dest < 0 || dest >= graph->V)
+    if (retired->supersededCount == retired->supersededCapacity)
     {
-        printf("Invalid source or destination node.\n");
+        retired->supersededCapacity = retired->supersededCapacity ? retired->supersededCapacity * 2 : 64;
+        retired->superseded = (struct Node **)realloc(retired->superseded,
+                                                      retired->supersededCapacity * sizeof(struct Node *));
+        if (!retired->superseded)
+        {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    retired->superseded[retired->supersededCount++] = node;
+}
+
+
+// Applies one vertex's edits to a persistent list. Nodes created by this
+// commit always form a prefix of the list (up to lastPrivate) and may be
+// changed in place; changing an older node copies the shared nodes from the
+// end of that prefix down to it, so the previous snapshot keeps its list.
+struct Node *editAdjacency(struct Graph *graph, struct Node *head, struct StagedEdge *edits, int count,
+                           struct RetiredGraph *retired)
+{
+    struct Node *lastPrivate = NULL;
+    for (int k = 0; k < count; k++)
+    {
+        int dest = toInternal(graph, edits[k].dest);
+        bool isPrivate = lastPrivate != NULL;
+        struct Node *found = head;
+        while (found && found->data != dest)
+        {
+            if (found == lastPrivate)
+            {
+                isPrivate = false;
+            }
+            found = found->next;
+        }
+
+        if (!found)
+        {
+            struct Node *newNode = createNode(dest, edits[k].distance, edits[k].direction);
+            newNode->next = head;
+            head = newNode;
+            if (!lastPrivate)
+            {
+                lastPrivate = newNode;
+            }
+            continue;
+        }
+        if (!isPrivate)
+        {
+            struct Node **link = lastPrivate ? &lastPrivate->next : &head;
+            struct Node *original = *link;
+            while (true)
+            {
+                struct Node *copy = createNode(original->data, original->distance, original->direction);
+                copy->profile = original->profile;
+                copy->next = original->next;
+                *link = copy;
+                addSupersededNode(retired, original);
+                lastPrivate = copy;
+                link = &copy->next;
+                if (original == found)
+                {
+                    found = copy;
+                    break;
+                }
+                original = original->next;
+            }
+        }
+        found->distance = edits[k].distance;
+        found->direction = edits[k].direction;
+    }
+    return head;
+}
+
+
+// Publishes the staged edits as a new snapshot. The snapshot copies only the
+// vertex blocks and path-copies only the lists it changes; everything else is
+// shared with the snapshot it replaces, whose superseded nodes and blocks are
+// freed once its last reader has left.
+void commitEdits(struct MapHandle *map, struct MapEditor *editor)
+{
+    pthread_mutex_lock(&map->writer);
+    struct Graph *base = atomic_load(&map->current);
+    if (!base->adjList || base->profiles)
+    {
+        printf("Live edits need uncompressed adjacency lists without travel-time profiles.\n");
+        pthread_mutex_unlock(&map->writer);
         return;
     }
 
-    bool *visited = (bool *)malloc(graph->V * sizeof(bool));
-    if (!visited)
+    for (int k = 0; !base->ids && k < editor->count; k++)
+    {
+        struct StagedEdge *edit = &editor->edits[k];
+        if (edit->srcId < 0 || edit->srcId >= INT_MAX || edit->destId < 0 || edit->destId >= INT_MAX)
+        {
+            printf("Edge %lld -> %lld needs a sparse map; nothing was committed.\n", edit->srcId, edit->destId);
+            pthread_mutex_unlock(&map->writer);
+            return;
+        }
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    struct RetiredGraph *retired = (struct RetiredGraph *)calloc(1, sizeof(struct RetiredGraph));
+    if (!retired)
     {
         perror("Memory allocation failed");
         exit(EXIT_FAILURE);
     }
+    retired->sharesLists = true;
+    struct Graph *graph = createGraph(0);
+    // A sparse map interns new IDs into the new snapshot's copy of its table,
+    // and shares the table when every ID is already known.
+    if (base->ids)
+    {
+        bool known = true;
+        for (int k = 0; known && k < editor->count; k++)
+        {
+            known = findId(base->ids, editor->edits[k].srcId) != -1 && findId(base->ids, editor->edits[k].destId) != -1;
+        }
+        graph->ids = known ? base->ids : copyIdTable(base->ids);
+        retired->sharesIds = known;
+    }
+    int V = base->V;
+    for (int k = 0; k < editor->count; k++)
+    {
+        struct StagedEdge *edit = &editor->edits[k];
+        edit->src = graph->ids ? internId(graph->ids, edit->srcId) : (int)edit->srcId;
+        edit->dest = graph->ids ? internId(graph->ids, edit->destId) : (int)edit->destId;
+        int largest = edit->src > edit->dest ? edit->src : edit->dest;
+        V = largest + 1 > V ? largest + 1 : V;
+    }
 
-    int *path = (int *)malloc(graph->V * sizeof(int));
-    if (!path)
+    // The snapshot starts out sharing every vertex block; a block is copied
+    // only when one of its lists changes.
+    int baseBlocks = adjacencyBlocks(base->V);
+    free(graph->adjList);
+    graph->V = V;
+    graph->adjList = (struct Node ***)malloc((baseBlocks + 1) * sizeof(struct Node **));
+    retired->supersededBlocks = (struct Node ***)malloc((baseBlocks + 1) * sizeof(struct Node **));
+    if (!graph->adjList || !retired->supersededBlocks)
     {
         perror("Memory allocation failed");
         exit(EXIT_FAILURE);
     }
+    memcpy(graph->adjList, base->adjList, baseBlocks * sizeof(struct Node **));
+    graph->adjList = growAdjacency(graph->adjList, base->V, V);
+    if (base->order && V == base->V)
+    {
+        graph->order = base->order;
+        graph->rank = base->rank;
+        retired->sharesOrder = true;
+    }
+    else if (base->order)
+    {
+        graph->order = (int *)malloc(V * sizeof(int));
+        graph->rank = (int *)malloc(V * sizeof(int));
+        if (!graph->order || !graph->rank)
+        {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+        memcpy(graph->order, base->order, base->V * sizeof(int));
+        memcpy(graph->rank, base->rank, base->V * sizeof(int));
+        for (int v = base->V; v < V; v++)
+        {
+            graph->order[v] = v;
+            graph->rank[v] = v;
+        }
+    }
 
-    for (int i = 0; i < graph->V; i++)
+    // The connectivity index stays valid while every edited edge joins
+    // vertices that could already reach each other; otherwise it is rebuilt
+    // by the first query that needs it.
+    struct ConnectivityIndex *index = atomic_load(&base->connectivity);
+    bool reachable = index && V == base->V;
+    for (int k = 0; reachable && k < editor->count; k++)
+    {
+        reachable = canReach(base, toInternal(base, editor->edits[k].src), toInternal(base, editor->edits[k].dest));
+    }
+    if (reachable)
     {
-        visited[i] = false;
+        atomic_store(&graph->connectivity, index);
+        retired->sharesConnectivity = true;
+    }
+    else
+    {
+        atomic_store(&graph->connectivityStale, true);
+    }
+
+    qsort(editor->edits, editor->count, sizeof(struct StagedEdge), compareStagedEdge);
+    int touched = 0;
+    for (int first = 0, last; first < editor->count; first = last)
+    {
+        last = first;
+        while (last < editor->count && editor->edits[last].src == editor->edits[first].src)
+        {
+            last++;
+        }
+        int u = toInternal(graph, editor->edits[first].src), b = u / ADJACENCY_BLOCK;
+        if (b < baseBlocks && graph->adjList[b] == base->adjList[b])
+        {
+            graph->adjList[b] = (struct Node **)malloc(ADJACENCY_BLOCK * sizeof(struct Node *));
+            if (!graph->adjList[b])
+            {
+                perror("Memory allocation failed");
+                exit(EXIT_FAILURE);
+            }
+            memcpy(graph->adjList[b], base->adjList[b], ADJACENCY_BLOCK * sizeof(struct Node *));
+            retired->supersededBlocks[retired->supersededBlockCount++] = base->adjList[b];
+        }
+        struct Node **slot = adjacencySlot(graph->adjList, u);
+        *slot = editAdjacency(graph, *slot, editor->edits + first, last - first, retired);
+        touched++;
+    }
+    if (base->pois)
+    {
+        graph->pois = copyPointsOfInterest(base->pois, graph);
     }
 
-    printf("Paths from node %d to node %d:\n", src, dest);
-    DFS(graph, src, dest, visited, path, 0, 0);
+    swapMap(map, graph, retired);
+    pthread_mutex_unlock(&map->writer);
+    printf("Committed %d edits on %d vertices (%d nodes and %d vertex blocks copied) in %.3f ms.\n",
+           editor->count, touched, retired->supersededCount, retired->supersededBlockCount,
+           elapsedSeconds(&start) * 1000);
+    editor->count = 0;
+}
 
-    free(visited);
-    free(path);
+
+// Runs before edits that change the current graph in place: waits, without
+// blocking any reader, until no other reader holds it and no older snapshot
+// still shares its lists, then returns it pinned for the menu (reader 0).
+struct Graph *waitForExclusiveMap(struct MapHandle *map)
+{
+    bool waited = false;
+    leaveMap(map, 0);
+    while (true)
+    {
+        reclaimRetiredGraphs(map);
+        pthread_mutex_lock(&map->lock);
+        bool exclusive = map->retired == NULL;
+        pthread_mutex_unlock(&map->lock);
+        for (int r = 1; r < MAX_MAP_READERS && exclusive; r++)
+        {
+            exclusive = atomic_load(&map->readers[r]) == 0;
+        }
+        if (exclusive)
+        {
+            return enterMap(map, 0);
+        }
+        if (!waited)
+        {
+            printf("Waiting for background readers of this map to finish...\n");
+            waited = true;
+        }
+        usleep(10000);
+    }
+}
+
+
+// The CSR pair is built once per snapshot, in place like the other changes
+// to the current graph, so it is never published while a reader holds it.
+struct Graph *ensureRangeIndex(struct MapHandle *map, struct Graph *graph)
+{
+    if (!graph->range)
+    {
+        graph = waitForExclusiveMap(map);
+        if (!graph->range)
+        {
+            graph->range = buildRangeIndex(graph);
+        }
+    }
+    return graph;
+}
+
+
+// The snapshot is pinned as reader 1 by the menu before this thread starts,
+// so an in-place edit can never begin between the start and the pin.
+void *backgroundBatch(void *arg)
+{
+    struct BackgroundBatch *job = (struct BackgroundBatch *)arg;
+    runQueryBatch(job->graph, job->queryFile, job->resultFile);
+    leaveMap(job->map, 1);
+    fflush(stdout);
+    atomic_store(&job->running, false);
+    return NULL;
+}
+
+
+// Bytes the allocator really holds for one block: the usable size plus the
+// chunk header on glibc, or the request rounded to 16 plus a header elsewhere.
+size_t allocationFootprint(void *ptr, size_t requested)
+{
+    if (!ptr)
+    {
+        return 0;
+    }
+#ifdef __GLIBC__
+    (void)requested;
+    return malloc_usable_size(ptr) + sizeof(size_t);
+#else
+    return ((requested + 15) & ~(size_t)15) + sizeof(size_t);
+#endif
+}
+
+
+size_t csrBytes(struct CSRGraph *csr)
+{
+    if (!csr)
+    {
+        return 0;
+    }
+    return sizeof(struct CSRGraph) + (csr->V + 1) * sizeof(int) +
+           (csr->E + 1) * (2 * sizeof(int) + sizeof(unsigned char));
 }
 
 
-struct Graph *loadMapFromFile(const char *filename)
-{
-    FILE *file = fopen(filename, "r");
-    if (!file)
+// Fills report with the bytes used by each structure of the graph and, when
+// given, the search workspace. Arrays are counted at their allocated length;
+// list nodes are counted one malloc at a time so allocator overhead shows up.
+void measureGraph(struct Graph *graph, struct SearchWorkspace *workspace, struct MemoryReport *report)
+{
+    memset(report, 0, sizeof(struct MemoryReport));
+    int V = graph->V;
+    report->graph = sizeof(struct Graph);
+
+    if (graph->adjList)
+    {
+        report->vertexArray = adjacencyBlocks(V) * (ADJACENCY_BLOCK + 1) * sizeof(struct Node *) +
+                              sizeof(struct Node **);
+        for (int u = 0; u < V; u++)
+        {
+            for (struct Node *temp = *adjacencySlot(graph->adjList, u); temp; temp = temp->next)
+            {
+                report->edges++;
+                report->edgeNodes += sizeof(struct Node);
+                report->nodeOverhead += allocationFootprint(temp, sizeof(struct Node)) - sizeof(struct Node);
+            }
+        }
+    }
+    if (graph->compressed)
+    {
+        report->edges = graph->compressed->E;
+        report->vertexArray = (V + 1) * sizeof(unsigned int);
+        report->compressed = sizeof(struct CompressedAdjacency) + graph->compressed->capacity;
+    }
+    if (graph->tiles)
+    {
+        struct TiledMap *tiles = graph->tiles;
+        pthread_mutex_lock(&tiles->lock);
+        report->edges = tiles->E;
+        report->tiles = sizeof(struct TiledMap) + (tiles->tileCount + 1) * (sizeof(struct TileEntry) +
+                        sizeof(struct Tile)) + tiles->resident;
+        pthread_mutex_unlock(&tiles->lock);
+    }
+#ifdef EMBEDDED_MAP
+    report->edges = EMBEDDED_E;
+    report->embedded = sizeof(embeddedOffsets) + sizeof(embeddedTargets) + sizeof(embeddedWeights) +
+                       sizeof(embeddedDirections);
+#endif
+    if (graph->order)
+    {
+        report->order = 2 * V * sizeof(int);
+    }
+    if (graph->ids)
+    {
+        report->ids = sizeof(struct IdTable) + graph->ids->capacity * sizeof(long long) +
+                      (graph->ids->slotMask + 1) * sizeof(int);
+    }
+
+    struct ConnectivityIndex *connectivity = graph->connectivity;
+    if (connectivity)
+    {
+        int components = connectivity->components;
+        report->connectivity = sizeof(struct ConnectivityIndex) + V * sizeof(int) +
+                               (components + 1) * sizeof(int) +
+                               (connectivity->dagOffsets[components] + 1) * sizeof(int) +
+                               4 * (components + 1) * sizeof(int);
+    }
+
+    if (graph->hubLabels)
+    {
+        report->hubLabels = sizeof(struct HubLabels) + (graph->hubLabels->V + 1) * sizeof(int);
+        report->hubLabelsMapped = graph->hubLabels->mapSize;
+    }
+
+    struct Overlay *overlay = graph->overlay;
+    if (overlay)
+    {
+        report->overlay = sizeof(struct Overlay) + overlay->levels * sizeof(struct OverlayLevel) +
+                          csrBytes(overlay->forward);
+        for (int level = 0; level < overlay->levels; level++)
+        {
+            struct OverlayLevel *cells = &overlay->level[level];
+            int count = cells->cellCount;
+            report->overlay += (V + 1) * sizeof(int) + 2 * V * sizeof(int) +
+                               2 * (count + 1) * sizeof(int) + (count + 1) * sizeof(long long) +
+                               (cells->entryOffsets[count] + 1) * sizeof(int) +
+                               (cells->exitOffsets[count] + 1) * sizeof(int) +
+                               (cells->matrixOffsets[count] + 1) * sizeof(int) + (count + 1);
+        }
+    }
+
+    struct ChainContraction *chains = graph->chains;
+    if (chains)
     {
-        perror("Failed to open the file for reading");
-        return NULL;
+        struct CSRGraph *reducedGraph = chains->graph;
+        int steps = chains->stepOffsets[reducedGraph->E];
+        report->chains = sizeof(struct ChainContraction) + csrBytes(reducedGraph) + 3 * V * sizeof(int) +
+                         (reducedGraph->V + 1) * sizeof(int) + (reducedGraph->E + 1) * sizeof(int) +
+                         (steps + 1) * (2 * sizeof(int) + 1);
     }
 
-    int V;
-    if (fscanf(file, "%d", &V) != 1)
+    struct ProfilePool *profiles = graph->profiles;
+    if (profiles)
     {
-        perror("Invalid file format");
-        fclose(file);
-        return NULL;
+        report->profiles = sizeof(struct ProfilePool) + (profiles->capacity + 1) * sizeof(int) +
+                           2 * profiles->pointCapacity * sizeof(int) + profiles->bucketCount * sizeof(int);
     }
 
-    struct Graph *graph = createGraph(V);
-    int src, dest, distance;
-    char directionStr[10];
-    while (fscanf(file, "%d %d %d %s", &src, &dest, &distance, directionStr) == 4)
+    struct RangeIndex *range = graph->range;
+    if (range)
     {
-        enum Direction direction;
-        if (strcmp(directionStr, "right") == 0) {
-            direction = RIGHT;
-        } else if (strcmp(directionStr, "left") == 0) {
-            direction = LEFT;
-        } else if (strcmp(directionStr, "straight") == 0) {
-            direction = STRAIGHT;
-        } else if (strcmp(directionStr, "back") == 0) {
-            direction = BACK;
-        } else {
-            printf("Invalid input for the direction. Please enter 'right', 'left', 'straight', or 'back'.\n");
-            continue;
-        }
+        report->rangeIndex = sizeof(struct RangeIndex) + csrBytes(range->forward) + csrBytes(range->reverse);
+    }
 
-        if (src >= 0 && src < graph->V && dest >= 0 && dest < graph->V)
+    struct PoiIndex *pois = graph->pois;
+    if (pois)
+    {
+        report->pois = sizeof(struct PoiIndex) + 2 * pois->capacity * sizeof(int) + pois->count * sizeof(int) +
+                       V * sizeof(int) + pois->tagCapacity * sizeof(*pois->tagNames);
+        if (pois->nearest)
         {
-            struct Node *newNode = createNode(dest, distance, direction);
-            newNode->next = graph->adjList[src];
-            graph->adjList[src] = newNode;
-
+            report->pois += 2 * (size_t)V * pois->nearestK * sizeof(int);
         }
     }
 
-    fclose(file);
-    return graph;
-}
-
-
-int minDistance(struct Graph *graph, bool visited[])
-{
-    int min = 10000, min_index;
-    for (int v = 0; v < graph->V; v++)
+    if (workspace)
     {
-        if (!visited[v] && graph->minDistance[v] < min)
+        report->workspace = sizeof(struct SearchWorkspace) +
+                            workspace->V * (3 * sizeof(int) + sizeof(bool) + sizeof(unsigned int)) +
+                            workspace->heap->capacity * sizeof(struct HeapEntry);
+        // The route trees are allocated by the first alternative-route query.
+        struct RouteTree *trees[2] = {workspace->forwardTree, workspace->backwardTree};
+        for (int k = 0; k < 2; k++)
         {
-            min = graph->minDistance[v];
-            min_index = v;
+            if (trees[k])
+            {
+                report->workspace += sizeof(struct RouteTree) +
+                                     trees[k]->V * (4 * sizeof(int) + 2 * sizeof(unsigned int));
+            }
         }
     }
-    return min_index;
+
+    report->total = report->graph + report->vertexArray + report->edgeNodes + report->nodeOverhead +
+                    report->compressed + report->tiles + report->order + report->ids + report->connectivity +
+                    report->hubLabels + report->overlay + report->chains + report->profiles + report->rangeIndex +
+                    report->pois + report->workspace;
 }
 
 
-void printShortestPath(struct Graph *graph, int parent[], int dest)
+void printMemoryLine(const char *name, size_t bytes, long long edges)
 {
-    if (parent[dest] == -1)
+    printf("  %-28s %12zu bytes", name, bytes);
+    if (edges > 0 && bytes > 0)
     {
-        printf("%d ", dest);
-        return;
+        printf("  %8.2f bytes/edge", (double)bytes / edges);
     }
-
-    printShortestPath(graph, parent, parent[dest]);
-    printf("%d ", dest);
+    printf("\n");
 }
 
 
-void dijkstra(struct Graph *graph, int src)
+void printMemoryReport(struct Graph *graph, struct SearchWorkspace *workspace)
 {
-    int parent[graph->V];
-    bool visited[graph->V];
+    struct MemoryReport report;
+    measureGraph(graph, workspace, &report);
+    long long E = report.edges;
 
-    for (int i = 0; i < graph->V; i++)
+    printf("Memory used by the loaded map (%d vertices, %lld edges, %s adjacency):\n", graph->V, E,
+           graph->compressed ? "compressed" : graph->tiles ? "tiled" : graph->adjList ? "linked-list" : "embedded");
+    printMemoryLine("Graph header", report.graph, 0);
+    printMemoryLine("Vertex array", report.vertexArray, E);
+    if (graph->compressed)
     {
-        parent[i] = -1;
-        graph->minDistance[i] = 10000;
-        visited[i] = false;
+        printMemoryLine("Compressed edge bytes", report.compressed, E);
     }
-
-    graph->minDistance[src] = 0;
-
-    for (int count = 0; count < graph->V - 1; count++)
+    else if (graph->tiles)
     {
-        int u = minDistance(graph, visited);
-        visited[u] = true;
-
-        struct Node *temp = graph->adjList[u];
-        while (temp != NULL)
+        struct TiledMap *tiles = graph->tiles;
+        pthread_mutex_lock(&tiles->lock);
+        int resident = 0;
+        for (int t = tiles->head; t != -1; t = tiles->tile[t].next)
         {
-            int v = temp->data;
-            int weight = temp->distance;
-
-            if (!visited[v] && graph->minDistance[u] != 10000 && graph->minDistance[u] + weight < graph->minDistance[v])
-            {
-                graph->minDistance[v] = graph->minDistance[u] + weight;
-                parent[v] = u;
-            }
-
-            temp = temp->next;
+            resident++;
         }
+        printf("  %d of %d tiles resident, cap %zu bytes, %lld loads, %lld evictions\n", resident,
+               tiles->tileCount, tiles->cacheBytes, tiles->loads, tiles->evictions);
+        pthread_mutex_unlock(&tiles->lock);
+        printMemoryLine("Tile directory and cache", report.tiles, E);
+    }
+    else if (report.embedded)
+    {
+        printMemoryLine("Embedded arrays (read-only)", report.embedded, E);
+    }
+    else
+    {
+        printMemoryLine("Edge nodes", report.edgeNodes, E);
+        printMemoryLine("Allocator overhead (nodes)", report.nodeOverhead, E);
     }
+    printMemoryLine("Vertex order", report.order, 0);
+    printMemoryLine("Sparse vertex IDs", report.ids, 0);
+    printMemoryLine("Connectivity index", report.connectivity, 0);
+    printMemoryLine("Hub labels (heap)", report.hubLabels, 0);
+    printMemoryLine("Hub labels (mapped file)", report.hubLabelsMapped, 0);
+    printMemoryLine("Multilevel overlay", report.overlay, 0);
+    printMemoryLine("Chain contraction", report.chains, 0);
+    printMemoryLine("Travel-time profiles", report.profiles, 0);
+    printMemoryLine("Range query cache", report.rangeIndex, 0);
+    printMemoryLine("Points of interest", report.pois, 0);
+    printMemoryLine("Search workspace", report.workspace, 0);
+    printMemoryLine("Total on the heap", report.total, E);
+    printMemoryLine("Adjacency storage only", report.vertexArray + report.edgeNodes + report.nodeOverhead +
+                    report.compressed + report.embedded + report.tiles, E);
+}
 
-    printf("Shortest paths from node %d:\n", src);
-    for (int i = 0; i < graph->V; i++)
+
+int main(int argc, char *argv[])
+{
+    bool compressed = false;
+    size_t tileCache = (size_t)TILE_CACHE_MB << 20;
+    for (int k = 1; k < argc; k++)
     {
-        if (i != src)
+        if (strcmp(argv[k], "--compressed") == 0)
+        {
+            compressed = true;
+        }
+        else if (strcmp(argv[k], "--tile-cache") == 0 && k + 1 < argc)
         {
-            printf("Path from %d to %d: ", src, i);
-            printShortestPath(graph, parent, i);
-            printf(" (Distance: %d)\n", graph->minDistance[i]);
+            tileCache = (size_t)atol(argv[++k]) << 20;
         }
     }
-}
 
-int main()
-{
     printf("Welcome to the Map Navigator!\n");
 
+#ifdef EMBEDDED_MAP
+    char filename[256] = "(embedded)";
+    struct Graph *graph = loadEmbeddedMap();
+    printf("Using the embedded map (%d vertices, %d edges).\n", EMBEDDED_V, EMBEDDED_E);
+#else
     printf("Enter the filename to load the map: ");
     char filename[256];
     scanf("%255s", filename);
 
-    struct Graph *graph = loadMapFromFile(filename);
+    struct Graph *graph = loadMap(filename, compressed, tileCache);
+#endif
 
     if (!graph)
     {
         printf("Failed to load the map. Exiting.\n");
         return 1;
     }
+    struct SearchWorkspace *workspace = createSearchWorkspace(graph->V);
+
+    // The menu is reader 0; SIGHUP is only taken by the watcher thread.
+    struct MapHandle map;
+    atomic_init(&map.current, graph);
+    atomic_init(&map.epoch, 1);
+    for (int r = 0; r < MAX_MAP_READERS; r++)
+    {
+        atomic_init(&map.readers[r], 0);
+    }
+    atomic_init(&map.stopping, false);
+    map.retired = NULL;
+    map.compressed = compressed;
+    map.tileCache = tileCache;
+    strcpy(map.filename, filename);
+    map.pendingFile[0] = '\0';
+    pthread_mutex_init(&map.lock, NULL);
+    pthread_mutex_init(&map.writer, NULL);
+    struct MapEditor editor = {NULL, 0, 0};
+    struct BackgroundBatch background;
+    background.map = &map;
+    atomic_init(&background.running, false);
+    background.started = false;
+#ifndef EMBEDDED_MAP
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    pthread_create(&map.watcher, NULL, mapWatcher, &map);
+#endif
 
     while (true)
     {
+        leaveMap(&map, 0);
+        reclaimRetiredGraphs(&map);
+
         printf("\nMenu:\n");
         printf("1. Find paths\n");
         printf("2. Print map\n");
         printf("3. Find shortest distance\n");
         printf("4. Exit\n");
+        printf("5. Reorder vertices for locality\n");
+        printf("6. Compress adjacency lists\n");
+        printf("7. Build hub labels\n");
+        printf("8. Load hub labels\n");
+        printf("9. Find shortest distance with hub labels\n");
+        printf("10. Build multilevel overlay\n");
+        printf("11. Apply distance updates from file\n");
+        printf("12. Find shortest path with overlay\n");
+        printf("13. Load travel-time profiles\n");
+        printf("14. Find fastest route at a departure time\n");
+        printf("15. Find all vertices within a distance budget\n");
+        printf("16. Find nearest points of interest\n");
+        printf("17. Build nearest points of interest index\n");
+        printf("18. Run shortest path queries from file\n");
+        printf("19. Reload the map from file\n");
+        printf("20. Stage an edge edit on the live map\n");
+        printf("21. Commit staged edits\n");
+        printf("22. Run shortest path queries from file in the background\n");
+        printf("23. Report memory usage\n");
+        printf("24. Count and list equal-cost shortest paths\n");
+        printf("25. Find alternative routes\n");
+        printf("26. Find routes trading distance for fewer turns\n");
+        printf("27. Assign every vertex to its nearest facility\n");
+        printf("28. Rank intersections and roads by betweenness\n");
+        printf("29. Contract pass-through chains\n");
+        printf("30. Find shortest path on the contracted map\n");
         printf("Enter your choice: ");
 
         int choice;
@@ -322,6 +8395,34 @@ int main()
             printf("Invalid input. Please enter a valid option.\n");
             continue;
         }
+#ifdef EMBEDDED_MAP
+        // The embedded map is read-only and cannot be replaced.
+        if (choice == 5 || choice == 6 || choice == 11 || choice == 13 || choice == 14 || choice == 19 ||
+            choice == 20 || choice == 21)
+        {
+            printf("Option %d needs a map loaded from file; the embedded map is read-only.\n", choice);
+            continue;
+        }
+#endif
+
+        graph = enterMap(&map, 0);
+        // These options search the forward and reverse CSR; it is built
+        // before any input is read, against the graph the input refers to.
+        // A tiled map would have to page in every tile to build it.
+        if (choice == 15 || choice == 16 || choice == 25 || choice == 27 || choice == 28 || choice == 29)
+        {
+            if (graph->tiles)
+            {
+                printf("Option %d needs the whole map in memory; tiled maps are paged from disk.\n", choice);
+                continue;
+            }
+            graph = ensureRangeIndex(&map, graph);
+        }
+        if (workspace->V != graph->V)
+        {
+            freeSearchWorkspace(workspace);
+            workspace = createSearchWorkspace(graph->V);
+        }
 
         switch (choice)
         {
@@ -329,12 +8430,12 @@ int main()
 {
     int src, dest;
     printf("Enter the source and destination nodes to find paths: ");
-    if (scanf("%d %d", &src, &dest) != 2)
+    if (!scanVertex(graph, &src) || !scanVertex(graph, &dest))
     {
         printf("Invalid input for source and destination nodes.\n");
         continue;
     }
-    findPaths(graph, src, dest);
+    findPaths(graph, workspace, src, dest);
     break;
 }
 
@@ -344,33 +8445,17 @@ int main()
         printf("\nMap representation:\n");
         for (int i = 0; i < graph->V; i++)
         {
-            struct Node *temp = graph->adjList[i];
-            if (temp != NULL) 
+            struct EdgeCursor cursor;
+            int dest, distance;
+            enum Direction direction;
+            firstEdge(graph, toInternal(graph, i), &cursor);
+            if (nextEdge(&cursor, &dest, &distance, &direction))
             {
-                printf("Adjacency list of vertex %d: ", i);
-                while (temp)
+                printf("Adjacency list of vertex %lld: ", mapId(graph, i));
+                printf("%lld (%d, %s)", vertexId(graph, dest), distance, directionName(direction));
+                while (nextEdge(&cursor, &dest, &distance, &direction))
                 {
-                    char *directionStr;
-                    switch (temp->direction) {
-                        case RIGHT:
-                            directionStr = "right";
-                            break;
-                        case LEFT:
-                            directionStr = "left";
-                            break;
-                        case STRAIGHT:
-                            directionStr = "straight";
-                            break;
-                        case BACK:
-                            directionStr = "back";
-                            break;
-                    }
-                    printf("%d (%d, %s)", temp->data, temp->distance, directionStr);
-                    temp = temp->next;
-                    if (temp != NULL)
-                    {
-                        printf(" -> ");
-                    }
+                    printf(" -> %lld (%d, %s)", vertexId(graph, dest), distance, directionName(direction));
                 }
                 printf("\n");
             }
@@ -382,18 +8467,22 @@ int main()
         case 4:
             {
                 printf("Exiting the Map Navigator. Goodbye!\n");
-                for (int i = 0; i < graph->V; i++)
+                if (background.started)
                 {
-                    struct Node *temp = graph->adjList[i];
-                    while (temp)
-                    {
-                        struct Node *next = temp->next;
-                        free(temp);
-                        temp = next;
-                    }
+                    pthread_join(background.thread, NULL);
                 }
-                free(graph->adjList);
-                free(graph);
+#ifndef EMBEDDED_MAP
+                atomic_store(&map.stopping, true);
+                pthread_kill(map.watcher, SIGHUP);
+                pthread_join(map.watcher, NULL);
+#endif
+                leaveMap(&map, 0);
+                reclaimRetiredGraphs(&map);
+                freeGraph(atomic_load(&map.current));
+                pthread_mutex_destroy(&map.lock);
+                pthread_mutex_destroy(&map.writer);
+                free(editor.edits);
+                freeSearchWorkspace(workspace);
                 return 0;
             }
 
@@ -401,8 +8490,421 @@ int main()
         {
             int src;
             printf("Enter the Vertex from which you have to find shortest path to other vertices : ");
-            scanf("%d",&src);
-            dijkstra(graph,src);
+            if (!scanVertex(graph, &src) || src < 0 || src >= graph->V)
+            {
+                printf("Invalid source node.\n");
+                break;
+            }
+            dijkstra(graph, workspace, src);
+            break;
+        }
+
+        case 5:
+        {
+            int ordering;
+            printf("Choose the ordering (1 = BFS, 2 = Reverse Cuthill-McKee): ");
+            if (scanf("%d", &ordering) != 1 || (ordering != 1 && ordering != 2))
+            {
+                printf("Invalid ordering.\n");
+                break;
+            }
+            graph = waitForExclusiveMap(&map);
+            reorderGraph(graph, ordering == 1 ? ORDER_BFS : ORDER_RCM);
+            break;
+        }
+
+        case 6:
+        {
+            if (graph->compressed)
+            {
+                printf("The adjacency is already compressed.\n");
+                break;
+            }
+            if (graph->tiles)
+            {
+                printf("Tiled maps are paged from disk and cannot be compressed in memory.\n");
+                break;
+            }
+            graph = waitForExclusiveMap(&map);
+            compressGraph(graph);
+            break;
+        }
+
+        case 7:
+        {
+            char labelFile[256], answer[8];
+            printf("Enter the filename to save the hub labels: ");
+            scanf("%255s", labelFile);
+            printf("Store parents for path retrieval? (y/n): ");
+            scanf("%7s", answer);
+            buildHubLabels(graph, labelFile, answer[0] == 'y' || answer[0] == 'Y');
+            break;
+        }
+
+        case 8:
+        {
+            char labelFile[256];
+            printf("Enter the filename of the hub labels: ");
+            scanf("%255s", labelFile);
+            struct HubLabels *labels = loadHubLabels(labelFile);
+            if (labels && labels->V != graph->V)
+            {
+                printf("The hub labels are for %d vertices but the map has %d.\n", labels->V, graph->V);
+                freeHubLabels(labels);
+            }
+            else if (labels)
+            {
+                freeHubLabels(graph->hubLabels);
+                graph->hubLabels = labels;
+                printf("Loaded hub labels for %d vertices.\n", labels->V);
+            }
+            break;
+        }
+
+        case 9:
+        {
+            int src, dest;
+            if (!graph->hubLabels)
+            {
+                printf("Load hub labels first.\n");
+                break;
+            }
+            printf("Enter the source and destination nodes: ");
+            if (!scanVertex(graph, &src) || !scanVertex(graph, &dest))
+            {
+                printf("Invalid input for source and destination nodes.\n");
+                break;
+            }
+            queryHubLabels(graph, graph->hubLabels, src, dest);
+            break;
+        }
+
+        case 10:
+        {
+            int cellSize;
+            printf("Enter the number of vertices per level-1 cell (e.g. 256): ");
+            if (scanf("%d", &cellSize) != 1 || cellSize < 2)
+            {
+                printf("Invalid cell size.\n");
+                break;
+            }
+            struct Overlay *overlay = buildOverlay(graph, cellSize);
+            if (overlay)
+            {
+                freeOverlay(graph->overlay);
+                graph->overlay = overlay;
+            }
+            break;
+        }
+
+        case 11:
+        {
+            char updateFile[256];
+            printf("Enter the filename with distance updates (source destination distance): ");
+            scanf("%255s", updateFile);
+            graph = waitForExclusiveMap(&map);
+            applyDistanceUpdates(graph, updateFile);
+            break;
+        }
+
+        case 12:
+        {
+            int src, dest;
+            if (!graph->overlay)
+            {
+                printf("Build the multilevel overlay first.\n");
+                break;
+            }
+            printf("Enter the source and destination nodes: ");
+            if (!scanVertex(graph, &src) || !scanVertex(graph, &dest) || src < 0 || src >= graph->V || dest < 0 ||
+                dest >= graph->V)
+            {
+                printf("Invalid source or destination node.\n");
+                break;
+            }
+            overlayShortestPath(graph, src, dest);
+            break;
+        }
+
+        case 13:
+        {
+            char profileFile[256];
+            printf("Enter the filename with travel-time profiles (source destination minute:time ...): ");
+            scanf("%255s", profileFile);
+            graph = waitForExclusiveMap(&map);
+            loadTravelTimeProfiles(graph, profileFile);
+            break;
+        }
+
+        case 14:
+        {
+            int src, dest, departure;
+            printf("Enter the source, destination and departure minute (0-%d): ", PROFILE_PERIOD - 1);
+            if (!scanVertex(graph, &src) || !scanVertex(graph, &dest) || scanf("%d", &departure) != 1 || src < 0 ||
+                src >= graph->V || dest < 0 || dest >= graph->V || departure < 0)
+            {
+                printf("Invalid input for the route.\n");
+                break;
+            }
+            if (!graph->adjList)
+            {
+                printf("Time-dependent routing needs the uncompressed adjacency lists.\n");
+                break;
+            }
+            timeDependentDijkstra(graph, src, dest, departure);
+            break;
+        }
+
+        case 15:
+        {
+            int source, budget, direction;
+            printf("Enter the vertex, the distance budget and 0 for reachable-from or 1 for can-reach: ");
+            if (!scanVertex(graph, &source) || scanf("%d %d", &budget, &direction) != 2 || source < 0 ||
+                source >= graph->V || budget < 0 || (direction != 0 && direction != 1))
+            {
+                printf("Invalid input for the range query.\n");
+                break;
+            }
+            rangeQuery(graph, workspace, source, budget, direction == 1);
+            break;
+        }
+
+        case 16:
+        case 17:
+        {
+            if (!graph->pois)
+            {
+                printf("The map has no points of interest.\n");
+                break;
+            }
+            int vertex = 0, k;
+            char tagName[32];
+            if (choice == 16)
+            {
+                printf("Enter the vertex, the number of points of interest and a tag (or 'any'): ");
+                if (!scanVertex(graph, &vertex) || scanf("%d %31s", &k, tagName) != 2 || vertex < 0 ||
+                    vertex >= graph->V)
+                {
+                    printf("Invalid input for the query.\n");
+                    break;
+                }
+            }
+            else
+            {
+                printf("Enter how many points of interest to keep per vertex and a tag (or 'any'): ");
+                if (scanf("%d %31s", &k, tagName) != 2)
+                {
+                    printf("Invalid input for the index.\n");
+                    break;
+                }
+            }
+            int tag = strcmp(tagName, "any") == 0 ? -1 : findPoiTag(graph->pois, tagName);
+            if (k < 1 || (tag == -1 && strcmp(tagName, "any") != 0))
+            {
+                printf("Invalid count or unknown tag.\n");
+                break;
+            }
+            if (choice == 16)
+            {
+                    nearestPointsOfInterest(graph, workspace, vertex, k, tag);
+            }
+            else
+            {
+                buildNearestPoiIndex(graph, k, tag);
+            }
+            break;
+        }
+
+        case 18:
+        {
+            char queryFile[256], resultFile[256];
+            printf("Enter the filename with queries (source destination) and the filename for results: ");
+            if (scanf("%255s %255s", queryFile, resultFile) != 2)
+            {
+                printf("Invalid input for the batch.\n");
+                break;
+            }
+            runQueryBatch(graph, queryFile, resultFile);
+            break;
+        }
+
+        case 19:
+        {
+            char mapFile[256];
+            printf("Enter the filename of the new map: ");
+            if (scanf("%255s", mapFile) != 1)
+            {
+                printf("Invalid filename.\n");
+                break;
+            }
+            requestMapReload(&map, mapFile);
+            printf("Loading %s in the background; queries use the current map until it is ready.\n", mapFile);
+            break;
+        }
+
+        case 20:
+        {
+            long long src, dest;
+            int distance;
+            char directionStr[10];
+            enum Direction direction;
+            printf("Enter edge (source, destination, distance, and direction): ");
+            if (scanf("%lld %lld %d %9s", &src, &dest, &distance, directionStr) != 4 ||
+                (!graph->ids && (src < 0 || src >= INT_MAX || dest < 0 || dest >= INT_MAX)) ||
+                distance < 0 || !parseDirection(directionStr, &direction))
+            {
+                printf("Invalid input for the edge.\n");
+                break;
+            }
+            addEdge(&editor, src, dest, distance, direction);
+            printf("%d edits staged.\n", editor.count);
+            break;
+        }
+
+        case 21:
+        {
+            if (editor.count == 0)
+            {
+                printf("No edits are staged.\n");
+                break;
+            }
+            commitEdits(&map, &editor);
+            break;
+        }
+
+        case 22:
+        {
+            if (atomic_load(&background.running))
+            {
+                printf("A background batch is already running.\n");
+                break;
+            }
+            printf("Enter the filename with queries (source destination) and the filename for results: ");
+            if (scanf("%255s %255s", background.queryFile, background.resultFile) != 2)
+            {
+                printf("Invalid input for the batch.\n");
+                break;
+            }
+            if (background.started)
+            {
+                pthread_join(background.thread, NULL);
+            }
+            atomic_store(&background.running, true);
+            background.started = true;
+            background.graph = enterMap(&map, 1);
+            pthread_create(&background.thread, NULL, backgroundBatch, &background);
+            break;
+        }
+
+        case 23:
+        {
+            printMemoryReport(graph, workspace);
+            break;
+        }
+
+        case 24:
+        {
+            int src, dest, limit;
+            printf("Enter the source, destination and how many tied paths to list: ");
+            if (!scanVertex(graph, &src) || !scanVertex(graph, &dest) || scanf("%d", &limit) != 1 || src < 0 ||
+                src >= graph->V || dest < 0 || dest >= graph->V || limit < 0)
+            {
+                printf("Invalid input for the query.\n");
+                break;
+            }
+            equalCostPaths(graph, workspace, src, dest, limit);
+            break;
+        }
+
+        case 25:
+        {
+            int src, dest, count;
+            printf("Enter the source, destination and number of alternatives (1-%d): ", MAX_ALTERNATIVES);
+            if (!scanVertex(graph, &src) || !scanVertex(graph, &dest) || scanf("%d", &count) != 1 || src < 0 ||
+                src >= graph->V || dest < 0 || dest >= graph->V || count < 1 || count > MAX_ALTERNATIVES)
+            {
+                printf("Invalid input for the query.\n");
+                break;
+            }
+            alternativeRoutes(graph, workspace, src, dest, count);
+            break;
+        }
+
+        case 26:
+        {
+            int src, dest;
+            printf("Enter the source and destination nodes: ");
+            if (!scanVertex(graph, &src) || !scanVertex(graph, &dest) || src < 0 || src >= graph->V || dest < 0 ||
+                dest >= graph->V)
+            {
+                printf("Invalid source or destination node.\n");
+                break;
+            }
+            paretoRoutes(graph, src, dest);
+            break;
+        }
+
+        case 27:
+        {
+            if (!graph->pois)
+            {
+                printf("The map has no points of interest.\n");
+                break;
+            }
+            char tagName[32], resultFile[256];
+            printf("Enter the facility tag (or 'any') and the filename for the assignment: ");
+            if (scanf("%31s %255s", tagName, resultFile) != 2)
+            {
+                printf("Invalid input for the partition.\n");
+                break;
+            }
+            int tag = strcmp(tagName, "any") == 0 ? -1 : findPoiTag(graph->pois, tagName);
+            if (tag == -1 && strcmp(tagName, "any") != 0)
+            {
+                printf("Unknown tag.\n");
+                break;
+            }
+            nearestFacilityPartition(graph, tag, resultFile);
+            break;
+        }
+
+        case 28:
+        {
+            int top, samples;
+            printf("Enter how many vertices and roads to list and how many sources to sample (0 = all): ");
+            if (scanf("%d %d", &top, &samples) != 2 || top < 0 || samples < 0)
+            {
+                printf("Invalid input for the ranking.\n");
+                break;
+            }
+            betweennessCentrality(graph, top, samples);
+            break;
+        }
+
+        case 29:
+        {
+            struct ChainContraction *chains = contractChains(graph);
+            freeChainContraction(graph->chains);
+            graph->chains = chains;
+            break;
+        }
+
+        case 30:
+        {
+            int src, dest;
+            if (!graph->chains)
+            {
+                printf("Contract the pass-through chains first.\n");
+                break;
+            }
+            printf("Enter the source and destination nodes: ");
+            if (!scanVertex(graph, &src) || !scanVertex(graph, &dest) || src < 0 || src >= graph->V || dest < 0 ||
+                dest >= graph->V)
+            {
+                printf("Invalid source or destination node.\n");
+                break;
+            }
+            chainShortestPath(graph, src, dest);
             break;
         }
 
@@ -10,12 +10,17 @@ enum Direction {
     BACK
 };
 
+// Each road is stored once and linked into the lists of both its ends: next
+// continues the list of src, nextReverse the list of data. Seen from data the
+// road leads back to src in the mirrored direction.
 struct Node
 {
+    int src;
     int data;
     int distance;
     enum Direction direction;
     struct Node *next;
+    struct Node *nextReverse;
 };
 
 
@@ -26,7 +31,7 @@ struct Graph
 };
 
 // Function to create a new node
-struct Node *createNode(int data, int distance, enum Direction direction)
+struct Node *createNode(int src, int data, int distance, enum Direction direction)
 {
     struct Node *newNode = (struct Node *)malloc(sizeof(struct Node));
     if (!newNode)
@@ -34,14 +39,72 @@ struct Node *createNode(int data, int distance, enum Direction direction)
         perror("Memory allocation failed");
         exit(EXIT_FAILURE);
     }
+    newNode->src = src;
     newNode->data = data;
     newNode->distance = distance;
     newNode->direction = direction;
     newNode->next = NULL;
+    newNode->nextReverse = NULL;
     return newNode;
 }
 
 
+// Function to get the direction of an edge travelled backwards
+enum Direction reverseDirection(enum Direction direction)
+{
+    switch (direction) {
+        case RIGHT:
+            return LEFT;
+        case LEFT:
+            return RIGHT;
+        case STRAIGHT:
+            return BACK;
+        default:
+            return STRAIGHT;
+    }
+}
+
+
+// Functions to walk the roads at vertex u, whichever end of them u is
+int neighborOf(struct Node *edge, int u)
+{
+    return edge->src == u ? edge->data : edge->src;
+}
+
+
+enum Direction directionFrom(struct Node *edge, int u)
+{
+    return edge->src == u ? edge->direction : reverseDirection(edge->direction);
+}
+
+
+struct Node *nextIncident(struct Node *edge, int u)
+{
+    return edge->src == u ? edge->next : edge->nextReverse;
+}
+
+
+// Function to link a road into the lists of both its ends. A loop at a
+// single vertex gets a second, mirrored node, as it lies twice in one list.
+void linkEdge(struct Graph *graph, int src, int dest, int distance, enum Direction direction)
+{
+    struct Node *newNode = createNode(src, dest, distance, direction);
+    newNode->next = graph->adjList[src];
+    graph->adjList[src] = newNode;
+    if (src == dest)
+    {
+        newNode = createNode(src, dest, distance, reverseDirection(direction));
+        newNode->next = graph->adjList[src];
+        graph->adjList[src] = newNode;
+    }
+    else
+    {
+        newNode->nextReverse = graph->adjList[dest];
+        graph->adjList[dest] = newNode;
+    }
+}
+
+
 // Function to create a new graph
 struct Graph *createGraph(int V)
 {
@@ -87,30 +150,7 @@ void addEdge(struct Graph *graph, int src, int dest, int distance, enum Directio
             graph->V = newV;
         }
 
-        struct Node *newNode = createNode(dest, distance, direction);
-        newNode->next = graph->adjList[src];
-        graph->adjList[src] = newNode;
-
-        // For the reverse edge, we'll need to determine the opposite direction
-        enum Direction reverseDirection;
-        switch (direction) {
-            case RIGHT:
-                reverseDirection = LEFT;
-                break;
-            case LEFT:
-                reverseDirection = RIGHT;
-                break;
-            case STRAIGHT:
-                reverseDirection = BACK;
-                break;
-            case BACK:
-                reverseDirection = STRAIGHT;
-                break;
-        }
-
-        newNode = createNode(src, distance, reverseDirection);
-        newNode->next = graph->adjList[dest];
-        graph->adjList[dest] = newNode;
+        linkEdge(graph, src, dest, distance, direction);
     }
     else
     {
@@ -129,7 +169,7 @@ void printGraph(struct Graph *graph)
         while (temp)
         {
             char *directionStr;
-            switch (temp->direction) {
+            switch (directionFrom(temp, i)) {
                 case RIGHT:
                     directionStr = "right";
                     break;
@@ -143,8 +183,8 @@ void printGraph(struct Graph *graph)
                     directionStr = "back";
                     break;
             }
-            printf("%d (%d, %s) -> ", temp->data, temp->distance, directionStr);
-            temp = temp->next;
+            printf("%d (%d, %s) -> ", neighborOf(temp, i), temp->distance, directionStr);
+            temp = nextIncident(temp, i);
         }
         printf("NULL\n");
     }
@@ -170,7 +210,7 @@ void saveMapToFile(struct Graph *graph, const char *filename)
         while (temp)
         {
             char *directionStr;
-            switch (temp->direction) {
+            switch (directionFrom(temp, i)) {
                 case RIGHT:
                     directionStr = "right";
                     break;
@@ -184,8 +224,8 @@ void saveMapToFile(struct Graph *graph, const char *filename)
                     directionStr = "back";
                     break;
             }
-            fprintf(file, "%d %d %d %s\n", i, temp->data, temp->distance, directionStr);
-            temp = temp->next;
+            fprintf(file, "%d %d %d %s\n", i, neighborOf(temp, i), temp->distance, directionStr);
+            temp = nextIncident(temp, i);
         }
     }
 
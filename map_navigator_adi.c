@@ -10,12 +10,17 @@ enum Direction {
     BACK
 };
 
+// Each road is stored once and linked into the lists of both its ends: next
+// continues the list of src, nextReverse the list of data. Seen from data the
+// road leads back to src in the mirrored direction.
 struct Node
 {
+    int src;
     int data;
     int distance;
     enum Direction direction;
     struct Node *next;
+    struct Node *nextReverse;
 };
 
 
@@ -26,7 +31,7 @@ struct Graph
 };
 
 // Function to create a new node
-struct Node *createNode(int data, int distance, enum Direction direction)
+struct Node *createNode(int src, int data, int distance, enum Direction direction)
 {
     struct Node *newNode = (struct Node *)malloc(sizeof(struct Node));
     if (!newNode)
@@ -34,14 +39,72 @@ struct Node *createNode(int data, int distance, enum Direction direction)
         perror("Memory allocation failed");
         exit(EXIT_FAILURE);
     }
+    newNode->src = src;
     newNode->data = data;
     newNode->distance = distance;
     newNode->direction = direction; // Set the direction field
     newNode->next = NULL;
+    newNode->nextReverse = NULL;
     return newNode;
 }
 
 
+// Function to get the direction of an edge travelled backwards
+enum Direction reverseDirection(enum Direction direction)
+{
+    switch (direction) {
+        case RIGHT:
+            return LEFT;
+        case LEFT:
+            return RIGHT;
+        case STRAIGHT:
+            return BACK;
+        default:
+            return STRAIGHT;
+    }
+}
+
+
+// Functions to walk the roads at vertex u, whichever end of them u is
+int neighborOf(struct Node *edge, int u)
+{
+    return edge->src == u ? edge->data : edge->src;
+}
+
+
+enum Direction directionFrom(struct Node *edge, int u)
+{
+    return edge->src == u ? edge->direction : reverseDirection(edge->direction);
+}
+
+
+struct Node *nextIncident(struct Node *edge, int u)
+{
+    return edge->src == u ? edge->next : edge->nextReverse;
+}
+
+
+// Function to link a road into the lists of both its ends. A loop at a
+// single vertex gets a second, mirrored node, as it lies twice in one list.
+void linkEdge(struct Graph *graph, int src, int dest, int distance, enum Direction direction)
+{
+    struct Node *newNode = createNode(src, dest, distance, direction);
+    newNode->next = graph->adjList[src];
+    graph->adjList[src] = newNode;
+    if (src == dest)
+    {
+        newNode = createNode(src, dest, distance, reverseDirection(direction));
+        newNode->next = graph->adjList[src];
+        graph->adjList[src] = newNode;
+    }
+    else
+    {
+        newNode->nextReverse = graph->adjList[dest];
+        graph->adjList[dest] = newNode;
+    }
+}
+
+
 // Function to create a new graph
 struct Graph *createGraph(int V)
 {
@@ -81,12 +144,12 @@ void DFS(struct Graph *graph, int src, int dest, bool visited[], int path[], int
             if (i < pathIndex - 1)
             {
                 struct Node *edge = graph->adjList[path[i]];
-                while (edge->data != path[i + 1])
+                while (neighborOf(edge, path[i]) != path[i + 1])
                 {
-                    edge = edge->next;
+                    edge = nextIncident(edge, path[i]);
                 }
                 char *directionStr;
-                switch (edge->direction) {
+                switch (directionFrom(edge, path[i])) {
                     case RIGHT:
                         directionStr = "right";
                         break;
@@ -112,7 +175,7 @@ void DFS(struct Graph *graph, int src, int dest, bool visited[], int path[], int
         struct Node *temp = graph->adjList[src];
         while (temp)
         {
-            int neighbor = temp->data;
+            int neighbor = neighborOf(temp, src);
             if (!visited[neighbor])
             {
                 int edgeDistance = temp->distance;
@@ -120,7 +183,7 @@ void DFS(struct Graph *graph, int src, int dest, bool visited[], int path[], int
                 DFS(graph, neighbor, dest, visited, path, totalDistance, pathIndex);
                 totalDistance -= edgeDistance;
             }
-            temp = temp->next;
+            temp = nextIncident(temp, src);
         }
     }
 
@@ -202,30 +265,7 @@ struct Graph *loadMapFromFile(const char *filename)
 
         if (src >= 0 && src < graph->V && dest >= 0 && dest < graph->V)
         {
-            struct Node *newNode = createNode(dest, distance, direction);
-            newNode->next = graph->adjList[src];
-            graph->adjList[src] = newNode;
-
-            // For the reverse edge, we'll need to determine the opposite direction
-            enum Direction reverseDirection;
-            switch (direction) {
-                case RIGHT:
-                    reverseDirection = LEFT;
-                    break;
-                case LEFT:
-                    reverseDirection = RIGHT;
-                    break;
-                case STRAIGHT:
-                    reverseDirection = BACK;
-                    break;
-                case BACK:
-                    reverseDirection = STRAIGHT;
-                    break;
-            }
-
-            newNode = createNode(src, distance, reverseDirection);
-            newNode->next = graph->adjList[dest];
-            graph->adjList[dest] = newNode;
+            linkEdge(graph, src, dest, distance, direction);
         }
     }
 
@@ -292,7 +332,7 @@ int main()
                 while (temp)
                 {
                     char *directionStr;
-                    switch (temp->direction) {
+                    switch (directionFrom(temp, i)) {
                         case RIGHT:
                             directionStr = "right";
                             break;
@@ -306,8 +346,8 @@ int main()
                             directionStr = "back";
                             break;
                     }
-                    printf("%d (%d, %s)", temp->data, temp->distance, directionStr);
-                    temp = temp->next;
+                    printf("%d (%d, %s)", neighborOf(temp, i), temp->distance, directionStr);
+                    temp = nextIncident(temp, i);
                     if (temp != NULL)
                     {
                         printf(" -> ");
@@ -323,13 +363,18 @@ int main()
         case 3:
             {
                 printf("Exiting the Map Navigator. Goodbye!\n");
+                // A road is freed from the list of its larger end, after
+                // the list of its smaller end has been walked past it.
                 for (int i = 0; i < graph->V; i++)
                 {
                     struct Node *temp = graph->adjList[i];
                     while (temp)
                     {
-                        struct Node *next = temp->next;
-                        free(temp);
+                        struct Node *next = nextIncident(temp, i);
+                        if (neighborOf(temp, i) <= i)
+                        {
+                            free(temp);
+                        }
                         temp = next;
                     }
                 }